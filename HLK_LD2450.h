@@ -2,37 +2,240 @@
 #define HLK_LD2450_h
 
 #include "limits.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
 //#define LOGGING 
 
-static uint16_t _readAndLogSerial()
-{
-  uint16_t result = Serial1.read();
-  Serial.print(result,HEX);
-  Serial.print(' ');
-  return result;
-}
-
-#ifdef LOGGING
-#define write_char(_uint16_tValue) Serial1.write(_uint16_tValue);Serial.print(_uint16_tValue,HEX);Serial.print(' ')
-#define read_char() _readAndLogSerial()
+#if defined(LOGGING) && defined(ARDUINO)
 #define endline() Serial.print('\n')
 #define log(...) Serial.print(__VA_ARGS__)
 #else
-#define write_char(_uint16_tValue) Serial1.write(_uint16_tValue)
-#define read_char() Serial1.read()
 #define endline() 
 #define log(...)
 #endif
 
+// Hot path diagnostics go into a RAM ring of fixed size binary records instead of being
+// printed as they happen, a record costs a few stores so the timing being diagnosed stays
+// intact. Drain the ring when the loop is idle (EventLog_DrainToSerial on Arduino) or read the
+// records with EventLog_Read and decode them later. Text log() is left for configuration.
+typedef enum LogEventId{
+  LogEvent_None = 0x0,
+  // A: bytes read, B: first two of them
+  LogEvent_Received = 0x1,
+  // A: command word, B: frame length
+  LogEvent_Sent = 0x2,
+  // A: command word, B: attempt
+  LogEvent_Retry = 0x3,
+  // A: command word, B: 1 when half a frame was sitting in the parser
+  LogEvent_AckTimeout = 0x4,
+  // A: expected command word, B: word that was ACKed
+  LogEvent_WrongAck = 0x5,
+  // A: command word, B: ACK status
+  LogEvent_Nack = 0x6,
+  // A: expected byte, B: byte received
+  LogEvent_HeaderMismatch = 0x7,
+  // A: expected byte, B: byte received
+  LogEvent_EndMismatch = 0x8,
+  // B: in-frame data length the frame claimed
+  LogEvent_FrameTooLarge = 0x9,
+  // A: first word byte, B: in-frame data length
+  LogEvent_Frame = 0xA,
+  // A: first word byte of the frame that was thrown away
+  LogEvent_Malformed = 0xB
+} LogEventId;
+
+// 8 bytes, little endian on every platform this runs on, so raw dumps decode anywhere
+typedef struct LogRecord{
+  uint32_t Time_us;
+  uint8_t Id;
+  uint8_t A;
+  uint16_t B;
+} LogRecord;
+
+// Records kept before new ones are dropped, must be a power of two
+#ifndef EVENT_LOG_SIZE
+#if defined(__AVR__)
+#define EVENT_LOG_SIZE 32
+#else
+#define EVENT_LOG_SIZE 1024
+#endif
+#endif
+
+#if (EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)) != 0
+#error EVENT_LOG_SIZE must be a power of two
+#endif
+
+typedef struct EventLog{
+  uint16_t Head;
+  uint16_t Tail;
+  // Records thrown away because nobody drained the ring in time
+  uint16_t Dropped;
+  struct LogRecord Records[EVENT_LOG_SIZE];
+} EventLog;
+
+#if defined(LOGGING)
+#define log_event(_id, _a, _b) EventLog_Write(&Events, (_id), (_a), (_b))
+
+static struct EventLog Events;
+#else
+#define log_event(_id, _a, _b)
+#endif
+
+#if defined(ARDUINO)
+#define _event_log_now() micros()
+#else
+// Timestamps are 0 unless the program provides a clock, e.g. PosixTransport's Micros
+static unsigned long (*EventLogClock)() = NULL;
+#define _event_log_now() (EventLogClock != NULL ? EventLogClock() : 0)
+#endif
+
+inline static void EventLog_Write(struct EventLog* events, uint8_t id, uint8_t a, uint16_t b)
+{
+  const uint16_t head = events->Head;
+  if((uint16_t)(head - events->Tail) >= EVENT_LOG_SIZE)
+  {
+    events->Dropped++;
+    return;
+  }
+
+  struct LogRecord* record = &events->Records[head & (EVENT_LOG_SIZE - 1)];
+  record->Time_us = _event_log_now();
+  record->Id = id;
+  record->A = a;
+  record->B = b;
+  events->Head = head + 1;
+}
+
+// Oldest record first, false when the ring is empty
+inline static bool EventLog_Read(struct EventLog* events, struct LogRecord* out)
+{
+  if(events->Tail == events->Head)
+  {
+    return false;
+  }
+
+  *out = events->Records[events->Tail & (EVENT_LOG_SIZE - 1)];
+  events->Tail++;
+  return true;
+}
+
+inline static const char* EventLog_Name(uint8_t id)
+{
+  switch(id)
+  {
+    case LogEvent_Received: return "RX";
+    case LogEvent_Sent: return "TX";
+    case LogEvent_Retry: return "RETRY";
+    case LogEvent_AckTimeout: return "T/O";
+    case LogEvent_WrongAck: return "WRG";
+    case LogEvent_Nack: return "NACK";
+    case LogEvent_HeaderMismatch: return "HDR";
+    case LogEvent_EndMismatch: return "EOF";
+    case LogEvent_FrameTooLarge: return "BIG";
+    case LogEvent_Frame: return "FRAME";
+    case LogEvent_Malformed: return "MLF";
+    default: return "?";
+  }
+}
+
+#if defined(LOGGING) && defined(ARDUINO)
+// Prints up to maxRecords records as "time_us NAME A B" lines, call it when nothing is
+// waiting on the radar, printing at 115200 baud takes about 2ms per line
+inline static void EventLog_DrainToSerial(size_t maxRecords = EVENT_LOG_SIZE)
+{
+  struct LogRecord record;
+  while(maxRecords-- > 0 && EventLog_Read(&Events, &record))
+  {
+    log(record.Time_us);log(' ');
+    log(EventLog_Name(record.Id));log(' ');
+    log(record.A, HEX);log(' ');
+    log(record.B, HEX);endline();
+  }
+
+  if(Events.Dropped > 0)
+  {
+    log("Dropped ");log(Events.Dropped);endline();
+    Events.Dropped = 0;
+  }
+}
+#endif
+
+static const uint8_t RadarHeader[4] = {0xAA, 0xFF, 0x03, 0x00};
+static const uint8_t RadarEndOfFrame[2] = {0x55, 0xCC};
+static const uint8_t ACKHeader[4] = {0xFD, 0xFC, 0xFB, 0xFA};
+static const uint8_t ACKEndOfFrame[4] = {0x04, 0x03, 0x02, 0x01};
+
+// Radar frames always carry 3 targets of 8 bytes each
+#define RADAR_FRAME_DATA_SIZE 24
+// The zone configuration ACK is the largest frame at 30 bytes of in-frame data
+#define MAX_FRAME_DATA_SIZE 30
+// Header + 2 byte length + in-frame data + EOF
+#define MAX_FRAME_SIZE (sizeof(ACKHeader) + 2 + MAX_FRAME_DATA_SIZE + sizeof(ACKEndOfFrame))
+// An ACK without in-frame data
+#define MIN_FRAME_SIZE (sizeof(ACKHeader) + 2 + sizeof(ACKEndOfFrame))
+#define RADAR_FRAME_SIZE (sizeof(RadarHeader) + RADAR_FRAME_DATA_SIZE + sizeof(RadarEndOfFrame))
+
+// 34 bytes, one byte per protocol byte instead of a uint16_t each
 typedef struct Command{
-  uint16_t Word[2];
-  size_t Size;
-  uint16_t Values[32];
-  bool Malformed;
-  bool TimedOut;
+  uint8_t Word[2];
+  uint8_t Size;
+  uint8_t Values[MAX_FRAME_DATA_SIZE];
+  uint8_t Malformed : 1;
+  uint8_t TimedOut : 1;
 } Command;
 
+// Complete command frame built at compile time so sending it is a single write
+//   FD FC FB FA | data length | command word | values | 04 03 02 01
+template<uint8_t Word, uint8_t... Values>
+struct CommandFrame{
+  static constexpr uint8_t Bytes[sizeof(ACKHeader) + 2 + 2 + sizeof...(Values) + sizeof(ACKEndOfFrame)] = {
+    0xFD, 0xFC, 0xFB, 0xFA,
+    (uint8_t)(2 + sizeof...(Values)), 0x00,
+    Word, 0x00,
+    Values...,
+    0x04, 0x03, 0x02, 0x01
+  };
+};
+
+template<uint8_t Word, uint8_t... Values>
+constexpr uint8_t CommandFrame<Word, Values...>::Bytes[];
+
+// How long to wait for the radar to acknowledge a command
+#ifndef ACK_TIMEOUT_MS
+#define ACK_TIMEOUT_MS 50
+#endif
+
+// Offset of the first value byte in a CommandFrame
+#define COMMAND_FRAME_VALUE_OFFSET 8
+
+typedef CommandFrame<0xFF, 0x01, 0x00> EnableConfigModeFrame;
+typedef CommandFrame<0xFE> DisableConfigModeFrame;
+typedef CommandFrame<0x80> SingleTargetTrackingFrame;
+typedef CommandFrame<0x90> MultiTargetTrackingFrame;
+typedef CommandFrame<0x91> ReadTrackingModeFrame;
+// value is the AvailableBaudRates index
+typedef CommandFrame<0xA1, 0x07, 0x00> SetBaudRateFrame;
+typedef CommandFrame<0xA2> ResetToFactorySettingsFrame;
+typedef CommandFrame<0xA3> RestartModuleFrame;
+// value is 0x0001 on, 0x0000 off
+typedef CommandFrame<0xA4, 0x01, 0x00> SetEnableBluetoothFrame;
+typedef CommandFrame<0xA5, 0x01, 0x00> GetMacAddressFrame;
+typedef CommandFrame<0xC1> GetZoneConfigurationFrame;
+// Set zone filtering carries 26 bytes of zones so it is built at runtime, see Command_SetZoneConfiguration
+#define SET_ZONE_CONFIGURATION_WORD 0xC2
+
+// Copies a single value CommandFrame into buffer with its 2 byte little endian value replaced
+// for the commands with a runtime parameter, e.g. the baud rate
+template<typename Frame>
+inline static void CommandFrame_WithValue(uint8_t (&buffer)[sizeof(Frame::Bytes)], uint16_t value)
+{
+  memcpy(buffer, Frame::Bytes, sizeof(Frame::Bytes));
+  buffer[COMMAND_FRAME_VALUE_OFFSET] = value & 0xFF;
+  buffer[COMMAND_FRAME_VALUE_OFFSET + 1] = value >> 8;
+}
+
 typedef enum AvailableBaudRates
 {
   b9600 = 0x1, 
@@ -45,6 +248,22 @@ typedef enum AvailableBaudRates
   b460800 = 0x8 
 } AvailableBaudRates;
 
+// Line speed of an AvailableBaudRates value, 0 for anything else
+constexpr unsigned long BaudRateValue(uint8_t baud)
+{
+  return baud == b9600 ? 9600UL :
+    baud == b19200 ? 19200UL :
+    baud == b38400 ? 38400UL :
+    baud == b57600 ? 57600UL :
+    baud == b115200 ? 115200UL :
+    baud == b230400 ? 230400UL :
+    baud == b256000 ? 256000UL :
+    baud == b460800 ? 460800UL : 0UL;
+}
+
+// The rate the radar ships with
+#define DEFAULT_RADAR_BAUD_RATE b256000
+
 typedef struct _MacAddress{
   // Example: 8F 27 2E B8 0F 65
   char Bytes[6];
@@ -97,6 +316,72 @@ typedef struct _ZoneFilteringConfig{
   ZoneRegion Zone3;
 } ZoneConfiguration;
 
+// Type followed by the three regions, the same layout is read by 0xC1 and written by 0xC2
+//   type  | zone1 xy/xy         | zone2 xy/xy         | zone3 xy/xy
+//   01 00 | E803 E803 18FC 8813 | 0000 0000 0000 0000 | 0000 0000 0000 0000
+// unlike target coordinates vertices are plain two's complement, E803 = 1000, 18FC = -1000
+#define ZONE_CONFIGURATION_SIZE 26
+
+inline static int16_t _DecodeInt16(const uint8_t* bytes)
+{
+  return (int16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+inline static uint8_t* _EncodeInt16(uint8_t* bytes, int value)
+{
+  *bytes++ = value & 0xFF;
+  *bytes++ = (value >> 8) & 0xFF;
+  return bytes;
+}
+
+inline static ZoneRegion _DecodeZoneRegion(const uint8_t* bytes)
+{
+  ZoneRegion region;
+  region.Start.X = _DecodeInt16(bytes + 0);
+  region.Start.Y = _DecodeInt16(bytes + 2);
+  region.End.X = _DecodeInt16(bytes + 4);
+  region.End.Y = _DecodeInt16(bytes + 6);
+  return region;
+}
+
+inline static uint8_t* _EncodeZoneRegion(uint8_t* bytes, const ZoneRegion* region)
+{
+  bytes = _EncodeInt16(bytes, region->Start.X);
+  bytes = _EncodeInt16(bytes, region->Start.Y);
+  bytes = _EncodeInt16(bytes, region->End.X);
+  return _EncodeInt16(bytes, region->End.Y);
+}
+
+// bytes holds ZONE_CONFIGURATION_SIZE bytes (ACK Values + 4)
+inline static ZoneConfiguration DecodeZoneConfiguration(const uint8_t* bytes)
+{
+  ZoneConfiguration config;
+  config.Type = (ZoneFilteringType)bytes[0];
+  config.Zone1 = _DecodeZoneRegion(bytes + 2);
+  config.Zone2 = _DecodeZoneRegion(bytes + 10);
+  config.Zone3 = _DecodeZoneRegion(bytes + 18);
+  return config;
+}
+
+// Writes ZONE_CONFIGURATION_SIZE bytes, coordinates are truncated to int16 like the radar does
+inline static void EncodeZoneConfiguration(const ZoneConfiguration* config, uint8_t* bytes)
+{
+  bytes = _EncodeInt16(bytes, config->Type);
+  bytes = _EncodeZoneRegion(bytes, &config->Zone1);
+  bytes = _EncodeZoneRegion(bytes, &config->Zone2);
+  _EncodeZoneRegion(bytes, &config->Zone3);
+}
+
+// Compares what would go over the wire so fields outside the int16 range compare like the radar sees them
+inline static bool ZoneConfigurationEquals(const ZoneConfiguration* left, const ZoneConfiguration* right)
+{
+  uint8_t a[ZONE_CONFIGURATION_SIZE];
+  uint8_t b[ZONE_CONFIGURATION_SIZE];
+  EncodeZoneConfiguration(left, a);
+  EncodeZoneConfiguration(right, b);
+  return memcmp(a, b, sizeof(a)) == 0;
+}
+
 typedef struct TrackedObject{
   // Distance horizontally from center of module in millimeters
   // Negative denotes located to left of module
@@ -110,6 +395,8 @@ typedef struct TrackedObject{
   int Speed;
   // individual distance gate size in mm? Whatever that means
   int DistanceResolution;
+  // false when the radar sent all zeros for this slot, i.e. there is no target
+  bool Present;
 } TrackedObject;
 
 typedef struct TrackedObjectGroup{
@@ -118,489 +405,2024 @@ typedef struct TrackedObjectGroup{
   struct TrackedObject Third;
 } TrackedObjectGroup;
 
-inline static void SendCommand(const struct Command* command);
-inline static void WaitForCommand(struct Command* expectedAndOut, bool allowMalformed, size_t timeout_ms, bool timeoutIsSuccess = false, bool resumeRadarIsSuccess = false);
-inline static struct Command ReadCommand(unsigned int timeout_ms = UINT_MAX);
-inline static void Command_EnableConfig();
-inline static void Command_DisableConfigMode();
-inline static void Command_SetSingleTargetTracking();
-inline static void Command_SetMultiTargetTracking();
-inline static unsigned int Command_ReadTrackingMode();
-inline static void Command_SetBaudRate(AvailableBaudRates baud);
-inline static ZoneConfiguration Command_GetZoneConfiguration();
-inline static MacAddress Command_GetMacAddress();
-inline static void Command_SetEnableBluetooth(bool enabled);
-inline static void Command_ResetToFactorySettings();
-inline static void Command_RestartModule();
-
-inline static void InitRadarOnSerial1()
-{
-  // Start Serial with radar
-  // The default baud rate of the radar serial port is 256000, 1 stop bit, no parity bit.
-  Serial1.begin(256000);
-
-  delay(3000);
+typedef enum FrameType{
+  FrameType_None = 0x0,
+  // Radar position data
+  // AA FF 03 00 | 24 bytes | 55 CC
+  FrameType_Radar = 0x1,
+  // Response to a command
+  // FD FC FB FA | 2 byte size | size bytes | 04 03 02 01
+  FrameType_ACK = 0x2
+} FrameType;
+
+typedef enum FrameParserState{
+  // Searching for / matching the 4 byte header
+  FrameParserState_Header = 0x0,
+  // Reading the 2 byte little endian in-frame data length (ACK only)
+  FrameParserState_Length = 0x1,
+  // Reading in-frame data into Frame.Values
+  FrameParserState_Payload = 0x2,
+  // Matching the end of frame bytes
+  FrameParserState_EndOfFrame = 0x3
+} FrameParserState;
+
+// Counters and latency histograms for the parser and the command path, define HLK_LD2450_STATS
+// before including this file to collect them, without it the fields and every update compile away.
+// Updates are a handful of increments per frame, cheap enough to leave on in production.
+#if defined(HLK_LD2450_STATS)
+#define stats_update(...) __VA_ARGS__
+#else
+#define stats_update(...)
+#endif
 
-  Command_EnableConfigMode();
-  //Command_ReadTrackingMode();
-  //Command_SetSingleTargetTracking();
-  //Command_ReadTrackingMode();
-  //Command_SetMultiTargetTracking();
-  //Command_ReadTrackingMode();
-  //Command_GetMacAddress();
-  //Command_SetEnableBluetooth(false);
-  //Command_ResetToFactorySettings();
-  //Command_RestartModule();
-  //Command_SetBaudRate(AvailableBaudRates::b9600);
-  Command_DisableConfigMode();
-}
+// Histogram buckets, Buckets[0] counts 0us, Buckets[i] counts [2^(i-1), 2^i)us and the last
+// bucket everything from 2^(STATS_HISTOGRAM_BUCKETS-2)us up, 16 buckets reach past 16ms
+#ifndef STATS_HISTOGRAM_BUCKETS
+#define STATS_HISTOGRAM_BUCKETS 16
+#endif
 
+typedef struct LatencyHistogram{
+  uint32_t Buckets[STATS_HISTOGRAM_BUCKETS];
+} LatencyHistogram;
 
-inline static struct Command SendCommandAndWaitForACK(struct Command* command, bool radarResumeIsSuccess = false)
+inline static void LatencyHistogram_Add(struct LatencyHistogram* histogram, unsigned long us)
 {
-  SendCommand(command);
-  
-  Command expectedAndResponse = {
-    .Word = {0xFD, 0xFC}, // ACK RESPONSE
-    .Size = 0,
-    .Values = {0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  uint8_t bucket = 0;
+  while(us != 0 && bucket < STATS_HISTOGRAM_BUCKETS - 1)
+  {
+    us >>= 1;
+    bucket++;
+  }
+  histogram->Buckets[bucket]++;
+}
 
-  const bool allowMalformed = true;
-  const unsigned int timeout_ms = 50;
-  const bool timeoutIsSuccess = true;
+// Upper bound in us of the bucket holding the given percentile, 0 when the histogram is empty
+// ULONG_MAX when it falls in the open ended last bucket
+inline static unsigned long LatencyHistogram_Percentile(const struct LatencyHistogram* histogram, uint8_t percent)
+{
+  uint32_t total = 0;
+  for(uint8_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+  {
+    total += histogram->Buckets[i];
+  }
 
-  WaitForCommand( &expectedAndResponse, 
-                  allowMalformed, 
-                  timeout_ms, 
-                  timeoutIsSuccess, 
-                  radarResumeIsSuccess );
+  if(total == 0)
+  {
+    return 0;
+  }
 
-  return expectedAndResponse;
+  // smallest count that covers percent of the samples, rounded up
+  const uint32_t wanted = (uint32_t)(((uint64_t)total * percent + 99) / 100);
+  uint32_t seen = 0;
+  for(uint8_t i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++)
+  {
+    seen += histogram->Buckets[i];
+    if(seen >= wanted && seen > 0)
+    {
+      return i == 0 ? 0 : (1UL << i) - 1;
+    }
+  }
+  return ULONG_MAX;
 }
 
-inline static void Command_EnableConfigMode()
+// Indexed by frame type, Radar first
+#define STATS_FRAME_RADAR 0
+#define STATS_FRAME_ACK 1
+
+typedef struct ParserStats{
+  // Complete frames, by type
+  uint32_t Frames[2];
+  // Bytes that never became part of a complete frame, noise between frames and frames abandoned halfway
+  uint32_t Discarded;
+  // A header byte that didn't match, by the type of frame being matched
+  uint32_t HeaderMismatches[2];
+  // An end of frame byte that didn't match, by type
+  uint32_t EndMismatches[2];
+  // ACKs claiming more in-frame data than any ACK has
+  uint32_t TooLarge;
+} ParserStats;
+
+// Per command word counters, words the library doesn't send share the last slot
+static const uint8_t StatsCommandWords[] = {0xFF, 0xFE, 0x80, 0x90, 0x91, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xC1, 0xC2};
+#define STATS_COMMAND_SLOTS (sizeof(StatsCommandWords) + 1)
+
+inline static uint8_t RadarStats_Slot(uint8_t word)
 {
-  const Command EnableConfiguration = {
-    .Word = {0xFF, 0x00},
-    .Size = 2,
-    .Values = {0x01, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  uint8_t slot = 0;
+  while(slot < sizeof(StatsCommandWords) && StatsCommandWords[slot] != word)
+  {
+    slot++;
+  }
+  return slot;
+}
 
-  log("Requesting Configuration Mode\n");
-  SendCommandAndWaitForACK(&EnableConfiguration);
-  log("\n Configuration Mode Enabled, Waiting for configuration command\n");
+typedef struct RadarStats{
+  // Indexed by RadarStats_Slot(word)
+  uint16_t Sent[STATS_COMMAND_SLOTS];
+  uint16_t Retries[STATS_COMMAND_SLOTS];
+  // ACKs that didn't arrive within AckTimeout_ms, or the deadline ran out
+  uint16_t Timeouts[STATS_COMMAND_SLOTS];
+  uint16_t Nacks[STATS_COMMAND_SLOTS];
+  // Radar frames that arrived while a command was waiting and were replaced by a newer one
+  // before TryReadCommand picked them up, the link only keeps the latest
+  uint32_t RadarOverruns;
+  // Time spent in the read that completed a frame: pulling bytes out of the port and parsing them
+  struct LatencyHistogram DecodeTime;
+  // From sending the attempt that got answered to its ACK
+  struct LatencyHistogram RoundTrip;
+} RadarStats;
+
+// Invoked by FrameParser_Feed for every complete frame when set
+typedef void (*FrameCallback)(const struct Command* frame, void* context);
+
+// Resumable frame parser, feed it whatever bytes you have whenever you have them
+// it keeps its place across partial frames and never waits on the serial port
+typedef struct FrameParser{
+  uint8_t State;
+  uint8_t Type;
+  // position within the current header, length, payload or EOF
+  uint8_t Index;
+  // a complete frame is waiting in Frame to be picked up by FrameParser_Poll
+  bool Ready;
+  // Optional, when set frames are handed here instead of waiting for FrameParser_Poll
+  FrameCallback OnFrame;
+  void* Context;
+  struct Command Frame;
+#if defined(HLK_LD2450_STATS)
+  struct ParserStats Stats;
+#endif
+} FrameParser;
+
+inline static void FrameParser_Init(struct FrameParser* parser, FrameCallback onFrame = NULL, void* context = NULL);
+inline static size_t FrameParser_Feed(struct FrameParser* parser, const uint8_t* bytes, size_t length);
+inline static bool FrameParser_Poll(struct FrameParser* parser, struct Command* out);
+inline static size_t FrameParser_Needed(const struct FrameParser* parser);
+
+inline static size_t EncodeCommand(const struct Command* command, uint8_t* buffer, size_t capacity);
+inline static size_t ParseFrame(const uint8_t* bytes, size_t length, struct Command* out);
+
+// Everything that talks to the radar is templated on a Transport, any type with these members will do:
+//
+// struct MyTransport{
+//   // (Re)opens the port at the given baud rate
+//   void Begin(unsigned long baud);
+//   // Bytes that can be read right now without waiting
+//   size_t Available();
+//   // Never waits, reads up to length bytes and returns how many were read
+//   size_t Read(uint8_t* buffer, size_t length);
+//   // Writes the whole buffer, returns how many bytes were written
+//   size_t Write(const uint8_t* buffer, size_t length);
+//   // Monotonic time
+//   unsigned long Millis();
+//   unsigned long Micros();
+//   // Waits up to ms, may return early when data arrives
+//   void Delay(unsigned long ms);
+// };
+//
+// ArduinoTransport below wraps Serial1 and friends, HLK_LD2450_Posix.h has a termios backend for Linux
+
+// Sees every chunk of bytes read from a port before it is parsed, micros is port.Micros() at the read
+typedef void (*ReceiveCallback)(const uint8_t* bytes, size_t length, unsigned long micros, void* context);
+
+// Per radar state that has to outlive a single call, e.g. a frame that was half read when a call timed out
+typedef struct RadarLink{
+  struct FrameParser Parser;
+  // Latest radar frame that arrived while waiting for an ACK, handed out by the next TryReadCommand
+  struct Command Radar;
+  bool RadarPending;
+  // Last zone configuration read from or written to the radar, valid when ZonesKnown
+  ZoneConfiguration Zones;
+  bool ZonesKnown;
+  // Optional tap on the receive path, e.g. a capture recorder (HLK_LD2450_Capture.h)
+  ReceiveCallback OnReceive;
+  void* ReceiveContext;
+#if defined(HLK_LD2450_STATS)
+  struct RadarStats Stats;
+#endif
+} RadarLink;
+
+typedef enum CommandResult{
+  CommandResult_Ok = 0x0,
+  // The radar answered with a non zero ACK status every time
+  CommandResult_Nack = 0x1,
+  // Nothing answered before the deadline
+  CommandResult_Timeout = 0x2,
+  // Bytes arrived but never lined up into the expected ACK
+  CommandResult_Desync = 0x3
+} CommandResult;
+
+// Bounds on how long a single command may take
+typedef struct CommandPolicy{
+  // Total time for all attempts
+  unsigned long Deadline_ms;
+  // Time to wait for each ACK before sending again
+  unsigned long AckTimeout_ms;
+  // Attempts after the first one
+  uint8_t MaxRetries;
+  // The radar sometimes answers disabling configuration mode by just resuming position data
+  bool RadarResumeIsSuccess;
+} CommandPolicy;
+
+#ifndef COMMAND_MAX_RETRIES
+#define COMMAND_MAX_RETRIES 3
+#endif
+
+#ifndef COMMAND_DEADLINE_MS
+#define COMMAND_DEADLINE_MS ((COMMAND_MAX_RETRIES + 1) * ACK_TIMEOUT_MS + ACK_TIMEOUT_MS)
+#endif
+
+static const struct CommandPolicy DefaultCommandPolicy = { COMMAND_DEADLINE_MS, ACK_TIMEOUT_MS, COMMAND_MAX_RETRIES, false };
+
+// One link per transport type unless the transport brings its own,
+// provide an overload of LinkOf for your transport type to run several radars on one type
+template<typename Transport>
+inline static struct RadarLink* LinkOf(Transport& port)
+{
+  static struct RadarLink link = {};
+  return &link;
 }
 
-inline static void Command_DisableConfigMode()
+#if defined(HLK_LD2450_STATS)
+// Counters are read straight from LinkOf(port)->Stats and LinkOf(port)->Parser.Stats
+template<typename Transport>
+inline static void ResetRadarStats(Transport& port)
 {
-  const Command DisableConfiguration = {
-    .Word = {0xFE, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  struct RadarLink* link = LinkOf(port);
+  memset(&link->Stats, 0, sizeof(struct RadarStats));
+  memset(&link->Parser.Stats, 0, sizeof(struct ParserStats));
+}
+#endif
 
-  log("Exiting Configuration Mode\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  const bool resumeRadarIsSuccess = true;
-  Command result = SendCommandAndWaitForACK(&DisableConfiguration, resumeRadarIsSuccess);
+// Upper bound on how long InitRadar waits for the radar to come up, at every rate it tries
+#ifndef INIT_TIMEOUT_MS
+#define INIT_TIMEOUT_MS 3000
+#endif
 
-  if(result.Values[4] != 0x0)
-  {
-    log("Failed to exit config mode, retrying\n");
-    Command_DisableConfigMode();
-  }
+// How often InitRadar asks an otherwise quiet radar to enter configuration mode
+#ifndef INIT_PROBE_INTERVAL_MS
+#define INIT_PROBE_INTERVAL_MS 100
+#endif
 
-  log("\n Configuration Mode Disabled, Resuming RADAR operation\n");
-}
+typedef struct InitReport{
+  bool Ready;
+  // From the start of InitRadar (or DetectBaudRate) until the first valid frame or ACK
+  unsigned long TimeToReady_ms;
+  // FrameType_Radar or FrameType_ACK, whichever showed up first
+  uint8_t FirstFrame;
+  // Enable configuration mode probes sent while waiting, at every rate tried
+  uint8_t Probes;
+  // AvailableBaudRates the radar answered at
+  uint8_t BaudRate;
+} InitReport;
+
+// How long DetectBaudRate listens at each rate, long enough for a probe and its ACK
+// even at 9600 baud and for a radar frame from a radar that is already reporting
+#ifndef AUTOBAUD_WINDOW_MS
+#define AUTOBAUD_WINDOW_MS 250
+#endif
 
-inline static void Command_SetSingleTargetTracking()
+template<typename Transport>
+inline static void SendCommand(Transport& port, const struct Command* command);
+template<typename Transport>
+inline static void WaitForCommand(Transport& port, struct Command* expectedAndOut, bool allowMalformed, size_t timeout_ms, bool timeoutIsSuccess = false, bool resumeRadarIsSuccess = false);
+// Only takes part in overload resolution for transports so ReadCommand(int) still finds the Serial1 version
+template<typename Transport>
+inline static auto ReadCommand(Transport& port, unsigned int timeout_ms = UINT_MAX) -> decltype(port.Available(), Command());
+template<typename Transport>
+inline static bool TryReadCommand(Transport& port, struct Command* out);
+template<typename Transport>
+inline static bool _TryReadParsedFrame(Transport& port, struct Command* out);
+template<typename Transport>
+inline static CommandResult ExecuteCommand(Transport& port, const uint8_t* frame, size_t length, struct Command* response, const struct CommandPolicy* policy = &DefaultCommandPolicy);
+template<typename Transport>
+inline static CommandResult Command_EnableConfigMode(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_DisableConfigMode(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_SetSingleTargetTracking(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_SetMultiTargetTracking(Transport& port);
+template<typename Transport>
+inline static unsigned int Command_ReadTrackingMode(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_SetBaudRate(Transport& port, AvailableBaudRates baud);
+template<typename Transport>
+inline static ZoneConfiguration Command_GetZoneConfiguration(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_SetZoneConfiguration(Transport& port, const ZoneConfiguration* config);
+template<typename Transport>
+inline static CommandResult GetZoneFiltering(Transport& port, ZoneConfiguration* out, bool refresh = false);
+template<typename Transport>
+inline static CommandResult SetZoneFiltering(Transport& port, const ZoneConfiguration* config);
+template<typename Transport>
+inline static MacAddress Command_GetMacAddress(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_SetEnableBluetooth(Transport& port, bool enabled);
+template<typename Transport>
+inline static CommandResult Command_ResetToFactorySettings(Transport& port);
+template<typename Transport>
+inline static CommandResult Command_RestartModule(Transport& port);
+template<typename Transport>
+inline static bool WaitForRadarReady(Transport& port, unsigned long timeout_ms, struct InitReport* report);
+template<typename Transport>
+inline static bool DetectBaudRate(Transport& port, struct InitReport* report, unsigned long window_ms = AUTOBAUD_WINDOW_MS);
+template<typename Transport>
+inline static CommandResult UpgradeBaudRate(Transport& port, AvailableBaudRates baud = b460800, struct InitReport* report = NULL);
+
+// Returns as soon as the radar sends a valid radar frame or answers a probe, at most timeout_ms
+// A booted radar streams position data on its own so usually no probe is needed, one that is
+// still starting up (or sat in configuration mode) gets an enable configuration mode probe
+// every INIT_PROBE_INTERVAL_MS. Leaves the radar out of configuration mode if it was probed.
+template<typename Transport>
+inline static bool WaitForRadarReady(Transport& port, unsigned long timeout_ms, struct InitReport* report)
 {
-  const Command SetSingleTargetTracking = {
-    .Word = {0x80, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  const unsigned long start = port.Millis();
+  unsigned long lastProbe = start;
+  struct Command frame;
 
-  log("Setting Tracking mode to single target tracking\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&SetSingleTargetTracking);
+  report->Ready = false;
+  report->TimeToReady_ms = 0;
+  report->FirstFrame = FrameType_None;
+  report->Probes = 0;
+  report->BaudRate = 0;
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  while(port.Millis() - start <= timeout_ms)
   {
-    log("Failed to set tracking mode, retrying\n");
-    Command_SetSingleTargetTracking();
-  }
+    const FrameType type = _TryReadFrame(port, &frame);
+    if(type == FrameType_Radar || (type == FrameType_ACK && frame.Size >= 2 && frame.Values[0] == 0xFF))
+    {
+      report->Ready = true;
+      report->TimeToReady_ms = port.Millis() - start;
+      report->FirstFrame = type;
+      break;
+    }
 
-  log("\n Successfully set mode to single target tracking, Resuming RADAR operation\n");
-}
+    if(type != FrameType_None)
+    {
+      continue;
+    }
 
-inline static void Command_SetMultiTargetTracking()
-{
-  const Command SetMultiTargetTracking = {
-    .Word = {0x90, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+    const unsigned long now = port.Millis();
+    if(now - lastProbe >= INIT_PROBE_INTERVAL_MS)
+    {
+      SendFrame(port, EnableConfigModeFrame::Bytes, sizeof(EnableConfigModeFrame::Bytes));
+      report->Probes++;
+      lastProbe = now;
+      continue;
+    }
 
-  log("Setting Tracking mode to multi target tracking\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&SetMultiTargetTracking);
+    port.Delay(1);
+  }
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  // a probe may have landed (or still be in flight) after radar data showed up,
+  // either way make sure the radar goes back to reporting positions
+  if(report->Ready && report->Probes > 0)
   {
-    log("Failed to set tracking mode, retrying\n");
-    Command_SetMultiTargetTracking();
+    Command_DisableConfigMode(port);
   }
 
-  log("\n Successfully set mode to multi target tracking, Resuming RADAR operation\n");
+  log("Radar ready after ");log(report->TimeToReady_ms);log("ms\n");
+
+  return report->Ready;
 }
 
-// 0 is single target tracking
-// 1 is multi target tracking
-inline static unsigned int Command_ReadTrackingMode()
+// Reopens the port at another rate, whatever was half parsed at the old rate is garbage
+template<typename Transport>
+inline static void _BeginAt(Transport& port, uint8_t baud)
 {
-  const Command GetTrackingMode = {
-    .Word = {0x91, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  struct RadarLink* link = LinkOf(port);
+  // the counters outlive the reset, bytes lost to the wrong rate were still lost
+  stats_update(const struct ParserStats stats = link->Parser.Stats);
+  FrameParser_Init(&link->Parser);
+  stats_update(link->Parser.Stats = stats);
+  link->RadarPending = false;
+
+  port.Begin(BaudRateValue(baud));
+}
 
-  log("Reading Tracking Mode\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&GetTrackingMode);
+// One WaitForRadarReady at baud, as part of a search that started at start: the probes of
+// every window so far and the time since start are added up in report
+template<typename Transport>
+inline static bool _WaitForRadarReadyAt(Transport& port, uint8_t baud, unsigned long timeout_ms, unsigned long start, uint8_t* probes, struct InitReport* report)
+{
+  _BeginAt(port, baud);
+  const unsigned long offset = port.Millis() - start;
+  const bool ready = WaitForRadarReady(port, timeout_ms, report);
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  *probes += report->Probes;
+  report->Probes = *probes;
+  if(ready)
   {
-    log("Failed to read tracking mode, retrying\n");
-    Command_ReadTrackingMode();
+    report->TimeToReady_ms += offset;
+    report->BaudRate = baud;
   }
+  return ready;
+}
 
-  // Radar ACK(success):
-  // FD FC FB FA 06 00 91 01 00 00 01 00 04 03 02 01
-  // The return value 0x0001 means that it is currently in single-target tracking mode.
-  // The return value of 0x0002 means that it is currently in multi-target tracking mode.
-  const unsigned int trackingMode = result.Values[4];
-
-  log("\n Current Tracking Mode: ");
-  switch(trackingMode)
+// Tries every rate but skip, fastest first, window_ms each and none past deadline_ms after start
+template<typename Transport>
+inline static bool _SweepBaudRates(Transport& port, struct InitReport* report, unsigned long window_ms, uint8_t skip, unsigned long start, unsigned long deadline_ms, uint8_t probes)
+{
+  for(uint8_t baud = b460800; baud >= b9600; baud--)
   {
-    case 1:
-      log("Single");
-      break;
-    case 2:
-      log("Multi");
-      break;
-    default:
-      log("ERROR");
+    const unsigned long elapsed = port.Millis() - start;
+    if(elapsed >= deadline_ms)
+    {
       break;
+    }
+    if(baud == skip)
+    {
+      continue;
+    }
+
+    const unsigned long remaining = deadline_ms - elapsed;
+    if(_WaitForRadarReadyAt(port, baud, remaining < window_ms ? remaining : window_ms, start, &probes, report))
+    {
+      return true;
+    }
   }
-  log(", Resuming RADAR operation\n");
 
-  return trackingMode;
+  _BeginAt(port, DEFAULT_RADAR_BAUD_RATE);
+  return false;
 }
 
+// Tries every AvailableBaudRates rate, fastest first, and leaves the port open at the first
+// one that gives a valid frame. Returns false (port at the default rate) when none did.
+template<typename Transport>
+inline static bool DetectBaudRate(Transport& port, struct InitReport* report, unsigned long window_ms)
+{
+  return _SweepBaudRates(port, report, window_ms, 0, port.Millis(), ULONG_MAX, 0);
+}
 
-// This command is used to set the baud rate of the serial port of the module, the configured value is not
-// lost when power down, and the configured value takes effect after restarting the module.
-inline static void Command_SetBaudRate(AvailableBaudRates baud)
+// Moves a radar that is ready at the current rate to a faster one, a 30 byte frame takes
+// 0.65ms on the wire at 460800 instead of 1.2ms at 256000.
+// The radar only switches after a restart so this sets the rate, restarts it, reopens the
+// port at the new rate and waits for the radar to come back. If it never shows up there the
+// rates are searched so the port is left wherever the radar ended up (see report->BaudRate).
+template<typename Transport>
+inline static CommandResult UpgradeBaudRate(Transport& port, AvailableBaudRates baud, struct InitReport* report)
 {
-  const Command SetBaudRateCommand = {
-    .Word = {0xA1, 0x00},
-    .Size = 2,
-    .Values = {(unsigned int)baud, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  struct InitReport localReport;
+  if(report == NULL)
+  {
+    report = &localReport;
+  }
 
-  log("Setting Baud Rate, setting does not apply till restart of module\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&SetBaudRateCommand);
+  CommandResult status = Command_EnableConfigMode(port);
+  if(status == CommandResult_Ok)
+  {
+    status = Command_SetBaudRate(port, baud);
+  }
+  if(status == CommandResult_Ok)
+  {
+    status = Command_RestartModule(port);
+  }
+  if(status != CommandResult_Ok)
+  {
+    // still at the old rate, leave it reporting
+    Command_DisableConfigMode(port);
+    return status;
+  }
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  _BeginAt(port, baud);
+  if(WaitForRadarReady(port, INIT_TIMEOUT_MS, report))
   {
-    log("Failed to set baud rate, retrying\n");
-    Command_SetBaudRate(baud);
+    report->BaudRate = baud;
+    return CommandResult_Ok;
   }
 
-  log("\n Successfully set baud rate, Resuming RADAR operation\n");
+  DetectBaudRate(port, report);
+  return CommandResult_Timeout;
 }
 
-// This command is used to restore all configuration values to unfactory values, and the configuration
-// values take effect after rebooting the module.
-inline static void Command_ResetToFactorySettings()
+// Opens the port and waits for the radar to be ready instead of sleeping a fixed 3 seconds
+// A radar that was moved to another rate (and restarted) is found by trying the other rates,
+// all within timeout_ms: the default rate gets whatever the other rates' AUTOBAUD_WINDOW_MS
+// leave of it, at least one window, so a radar that is still booting has the most time there
+// report is optional, fill it to see how long it took and which rate the radar is on
+// Settings are changed once it returns, e.g. with a ConfigSession or the Command_* functions
+template<typename Transport>
+inline static bool InitRadar(Transport& port, struct InitReport* report = NULL, unsigned long timeout_ms = INIT_TIMEOUT_MS)
 {
-  const Command ResetCommand = {
-    .Word = {0xA2, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  struct InitReport localReport;
+  if(report == NULL)
+  {
+    report = &localReport;
+  }
 
-  log("Resetting module to factory settings, does not apply till module has been restarted\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&ResetCommand);
+  // may be a different radar than last time
+  LinkOf(port)->ZonesKnown = false;
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  const unsigned long start = port.Millis();
+  const unsigned long sweep_ms = (unsigned long)(b460800 - b9600) * AUTOBAUD_WINDOW_MS;
+  unsigned long default_ms = timeout_ms > sweep_ms ? timeout_ms - sweep_ms : 0;
+  if(default_ms < AUTOBAUD_WINDOW_MS)
   {
-    log("Failed to reset to factory settings, retrying\n");
-    Command_ResetToFactorySettings();
+    default_ms = timeout_ms < AUTOBAUD_WINDOW_MS ? timeout_ms : AUTOBAUD_WINDOW_MS;
   }
+  uint8_t probes = 0;
 
-  log("\n Successfully set mode to multi target tracking, Resuming RADAR operation\n");
-}
+  // The default baud rate of the radar serial port is 256000, 1 stop bit, no parity bit.
+  if(_WaitForRadarReadyAt(port, DEFAULT_RADAR_BAUD_RATE, default_ms, start, &probes, report))
+  {
+    return true;
+  }
 
-inline static void Command_RestartModule()
-{
-  const Command RestartModule = {
-    .Word = {0xA3, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  return _SweepBaudRates(port, report, AUTOBAUD_WINDOW_MS, DEFAULT_RADAR_BAUD_RATE, start, timeout_ms, probes);
+}
 
-  log("Restarting module\n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&RestartModule);
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
-  {
-    log("Failed to restart module, retrying\n");
-    Command_RestartModule();
-  }
+// Sends an already encoded frame with one write
+template<typename Transport>
+inline static void SendFrame(Transport& port, const uint8_t* frame, size_t length)
+{
+  log_event(LogEvent_Sent, frame[COMMAND_FRAME_VALUE_OFFSET - 2], length);
+  stats_update(LinkOf(port)->Stats.Sent[RadarStats_Slot(frame[COMMAND_FRAME_VALUE_OFFSET - 2])]++);
 
-  log("\n Successfully Restarted Module, Module will resume RADAR operation on restart\n");
+  port.Write(frame, length);
 }
 
-// This command is used to control the Bluetooth on or off, the Bluetooth function of the module is on
-// by default. The configured value is not lost when power down, and the configured value takes effect
-// after restarting the module.
-inline static void Command_SetEnableBluetooth(bool enabled)
+// Mimic valid response since the radar decides to just resume the radar instead of sending valid data
+inline static void _MimicSuccessfulACK(struct Command* out, uint8_t word)
 {
-  const Command EnableOrDisableBluetooth = {
-    .Word = {0xA4, 0x00},
-    .Size = 0,
-    .Values = {enabled ? 0x01 : 0x00, 0x00}, // 0x0100 turn on bluetooth 0x0000 turn off bluetooth (little endian)
-    .Malformed = false,
-    .TimedOut = false
-  };
+  out->Word[0] = 0xFD;
+  out->Word[1] = 0xFC;
+  out->Size = 4;
+  out->Values[0] = word;
+  out->Values[1] = 0x01;
+  out->Values[2] = 0x0;
+  out->Values[3] = 0x0;
+  out->Values[4] = 0x0;
+  out->Malformed = false;
+  out->TimedOut = false;
+}
 
-  log(enabled ? "Enabling " : "Disabling ");
-  log("Bluetooth \n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command result = SendCommandAndWaitForACK(&EnableOrDisableBluetooth);
+// Pulls the next complete frame out of the port without waiting
+// ACKs are written to out, radar frames are kept in the link for the next TryReadCommand
+template<typename Transport>
+inline static FrameType _TryReadFrame(Transport& port, struct Command* out)
+{
+  struct RadarLink* link = LinkOf(port);
+  if(!_TryReadParsedFrame(port, out))
+  {
+    return FrameType_None;
+  }
 
-  if(result.Values[2] != 0x0 || result.Values[3] != 0x0)
+  if(out->Word[0] != 0xAA)
   {
-    log("Failed to set bluetooth mode, retrying\n");
-    Command_SetEnableBluetooth(enabled);
+    return FrameType_ACK;
+  }
+
+  // the newest position data wins, nothing is older than one frame when config is done
+  stats_update(link->Stats.RadarOverruns += link->RadarPending);
+  link->Radar = *out;
+  link->RadarPending = true;
+  return FrameType_Radar;
+}
+
+// Sends frame and waits for its ACK as an explicit state machine, no recursion
+// Retries on timeouts and non zero ACK status until policy->MaxRetries or the overall
+// policy->Deadline_ms runs out, whichever comes first, so the worst case is bounded.
+// Radar frames that arrive in between don't count against the retries and are kept for TryReadCommand.
+template<typename Transport>
+inline static CommandResult ExecuteCommand(Transport& port, const uint8_t* frame, size_t length, struct Command* response, const struct CommandPolicy* policy)
+{
+  // FD FC FB FA | length | word
+  const uint8_t word = frame[COMMAND_FRAME_VALUE_OFFSET - 2];
+  const unsigned long start = port.Millis();
+  unsigned long attemptStart = start;
+  uint8_t attempts = 0;
+  CommandResult result = CommandResult_Timeout;
+#if defined(HLK_LD2450_STATS)
+  struct RadarStats* stats = &LinkOf(port)->Stats;
+  const uint8_t slot = RadarStats_Slot(word);
+  unsigned long sent_us = 0;
+#endif
+
+  enum { Sending, Waiting, Done } state = Sending;
+
+  while(state != Done)
+  {
+    const unsigned long now = port.Millis();
+
+    switch(state)
+    {
+      case Sending:
+        if(attempts > policy->MaxRetries || now - start > policy->Deadline_ms)
+        {
+          state = Done;
+          break;
+        }
+
+        if(attempts > 0)
+        {
+          log_event(LogEvent_Retry, word, attempts);
+          stats_update(stats->Retries[slot]++);
+        }
+
+        stats_update(sent_us = port.Micros());
+        SendFrame(port, frame, length);
+        attempts++;
+        attemptStart = now;
+        state = Waiting;
+        break;
+      case Waiting:
+      {
+        if(now - start > policy->Deadline_ms)
+        {
+          log_event(LogEvent_AckTimeout, word, 0);
+          stats_update(stats->Timeouts[slot]++);
+          state = Done;
+          break;
+        }
+
+        const FrameType type = _TryReadFrame(port, response);
+
+        if(type == FrameType_None)
+        {
+          if(now - attemptStart > policy->AckTimeout_ms)
+          {
+            // half a frame sitting in the parser means bytes are arriving but not lining up
+            const struct FrameParser* parser = &LinkOf(port)->Parser;
+            const bool midFrame = parser->State != FrameParserState_Header || parser->Index != 0;
+            log_event(LogEvent_AckTimeout, word, midFrame);
+            stats_update(stats->Timeouts[slot]++);
+            result = midFrame ? CommandResult_Desync : CommandResult_Timeout;
+            state = Sending;
+            break;
+          }
+
+          port.Delay(1);
+          break;
+        }
+
+        if(type == FrameType_Radar)
+        {
+          if(policy->RadarResumeIsSuccess)
+          {
+            _MimicSuccessfulACK(response, word);
+            result = CommandResult_Ok;
+            state = Done;
+          }
+          break;
+        }
+
+        // ACK data: word | 01 | 2 byte status | return values
+        if(response->Size < 4 || response->Values[0] != word || response->Values[1] != 0x01)
+        {
+          // late ACK for something else, e.g. a previous attempt of another command
+          log_event(LogEvent_WrongAck, word, response->Values[0]);
+          result = CommandResult_Desync;
+          break;
+        }
+
+        if(response->Values[2] == 0x0 && response->Values[3] == 0x0)
+        {
+          stats_update(LatencyHistogram_Add(&stats->RoundTrip, port.Micros() - sent_us));
+          result = CommandResult_Ok;
+          state = Done;
+          break;
+        }
+
+        log_event(LogEvent_Nack, word, response->Values[2] | (response->Values[3] << 8));
+        stats_update(stats->Nacks[slot]++);
+        result = CommandResult_Nack;
+        state = Sending;
+        break;
+      }
+      default:
+        state = Done;
+        break;
+    }
+  }
+
+  if(result != CommandResult_Ok)
+  {
+    response->Malformed = true;
+    response->TimedOut = result == CommandResult_Timeout;
+  }
+
+  return result;
+}
+
+// Writes the ACK into the caller's response instead of returning a copy
+template<typename Transport>
+inline static CommandResult SendFrameAndWaitForACK(Transport& port, const uint8_t* frame, size_t length, struct Command* response, bool radarResumeIsSuccess = false)
+{
+  memset(response, 0, sizeof(struct Command));
+
+  struct CommandPolicy policy = DefaultCommandPolicy;
+  policy.RadarResumeIsSuccess = radarResumeIsSuccess;
+
+  return ExecuteCommand(port, frame, length, response, &policy);
+}
+
+template<typename Frame, typename Transport>
+inline static CommandResult SendFrameAndWaitForACK(Transport& port, struct Command* response, bool radarResumeIsSuccess = false)
+{
+  return SendFrameAndWaitForACK(port, Frame::Bytes, sizeof(Frame::Bytes), response, radarResumeIsSuccess);
+}
+
+template<typename Transport>
+inline static CommandResult SendCommandAndWaitForACK(Transport& port, const struct Command* command, struct Command* response, bool radarResumeIsSuccess = false)
+{
+  uint8_t frame[MAX_FRAME_SIZE];
+  const size_t length = EncodeCommand(command, frame, sizeof(frame));
+  if(length == 0)
+  {
+    log("Attempted to send command larger than this program supports: ");
+    log(command->Size);
+    endline();
+    memset(response, 0, sizeof(struct Command));
+    response->Malformed = true;
+    return CommandResult_Desync;
+  }
+
+  return SendFrameAndWaitForACK(port, frame, length, response, radarResumeIsSuccess);
+}
+
+template<typename Transport>
+inline static CommandResult Command_EnableConfigMode(Transport& port)
+{
+  log("Requesting Configuration Mode\n");
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<EnableConfigModeFrame>(port, &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to enter config mode\n");
+    return status;
+  }
+
+  log("\n Configuration Mode Enabled, Waiting for configuration command\n");
+  return status;
+}
+
+template<typename Transport>
+inline static CommandResult Command_DisableConfigMode(Transport& port)
+{
+  log("Exiting Configuration Mode\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  const bool resumeRadarIsSuccess = true;
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<DisableConfigModeFrame>(port, &result, resumeRadarIsSuccess);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to exit config mode\n");
+    return status;
+  }
+
+  log("\n Configuration Mode Disabled, Resuming RADAR operation\n");
+  return status;
+}
+
+template<typename Transport>
+inline static CommandResult Command_SetSingleTargetTracking(Transport& port)
+{
+  log("Setting Tracking mode to single target tracking\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<SingleTargetTrackingFrame>(port, &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to set tracking mode\n");
+    return status;
+  }
+
+  log("\n Successfully set mode to single target tracking, Resuming RADAR operation\n");
+  return status;
+}
+
+template<typename Transport>
+inline static CommandResult Command_SetMultiTargetTracking(Transport& port)
+{
+  log("Setting Tracking mode to multi target tracking\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<MultiTargetTrackingFrame>(port, &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to set tracking mode\n");
+    return status;
+  }
+
+  log("\n Successfully set mode to multi target tracking, Resuming RADAR operation\n");
+  return status;
+}
+
+// 1 is single target tracking
+// 2 is multi target tracking
+// 0 if the radar didn't answer
+template<typename Transport>
+inline static unsigned int Command_ReadTrackingMode(Transport& port)
+{
+  log("Reading Tracking Mode\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  if(SendFrameAndWaitForACK<ReadTrackingModeFrame>(port, &result) != CommandResult_Ok)
+  {
+    log("Failed to read tracking mode\n");
+    return 0;
+  }
+
+  // Radar ACK(success):
+  // FD FC FB FA 06 00 91 01 00 00 01 00 04 03 02 01
+  // The return value 0x0001 means that it is currently in single-target tracking mode.
+  // The return value of 0x0002 means that it is currently in multi-target tracking mode.
+  const unsigned int trackingMode = result.Values[4];
+
+  log("\n Current Tracking Mode: ");
+  switch(trackingMode)
+  {
+    case 1:
+      log("Single");
+      break;
+    case 2:
+      log("Multi");
+      break;
+    default:
+      log("ERROR");
+      break;
+  }
+  log(", Resuming RADAR operation\n");
+
+  return trackingMode;
+}
+
+
+// This command is used to set the baud rate of the serial port of the module, the configured value is not
+// lost when power down, and the configured value takes effect after restarting the module.
+template<typename Transport>
+inline static CommandResult Command_SetBaudRate(Transport& port, AvailableBaudRates baud)
+{
+  uint8_t frame[sizeof(SetBaudRateFrame::Bytes)];
+  CommandFrame_WithValue<SetBaudRateFrame>(frame, baud);
+
+  log("Setting Baud Rate, setting does not apply till restart of module\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK(port, frame, sizeof(frame), &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to set baud rate\n");
+    return status;
+  }
+
+  log("\n Successfully set baud rate, Resuming RADAR operation\n");
+  return status;
+}
+
+// This command is used to restore all configuration values to unfactory values, and the configuration
+// values take effect after rebooting the module.
+template<typename Transport>
+inline static CommandResult Command_ResetToFactorySettings(Transport& port)
+{
+  log("Resetting module to factory settings, does not apply till module has been restarted\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<ResetToFactorySettingsFrame>(port, &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to reset to factory settings\n");
+    return status;
+  }
+
+  LinkOf(port)->ZonesKnown = false;
+
+  log("\n Successfully reset to factory settings, Resuming RADAR operation\n");
+  return status;
+}
+
+template<typename Transport>
+inline static CommandResult Command_RestartModule(Transport& port)
+{
+  log("Restarting module\n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK<RestartModuleFrame>(port, &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to restart module\n");
+    return status;
+  }
+
+  log("\n Successfully Restarted Module, Module will resume RADAR operation on restart\n");
+  return status;
+}
+
+// This command is used to control the Bluetooth on or off, the Bluetooth function of the module is on
+// by default. The configured value is not lost when power down, and the configured value takes effect
+// after restarting the module.
+template<typename Transport>
+inline static CommandResult Command_SetEnableBluetooth(Transport& port, bool enabled)
+{
+  uint8_t frame[sizeof(SetEnableBluetoothFrame::Bytes)];
+  // 0x0100 turn on bluetooth 0x0000 turn off bluetooth (little endian)
+  CommandFrame_WithValue<SetEnableBluetoothFrame>(frame, enabled ? 0x0001 : 0x0000);
+
+  log(enabled ? "Enabling " : "Disabling ");
+  log("Bluetooth \n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command result;
+  const CommandResult status = SendFrameAndWaitForACK(port, frame, sizeof(frame), &result);
+
+  if(status != CommandResult_Ok)
+  {
+    log("Failed to set bluetooth mode\n");
+    return status;
   }
 
   log("\n Successfully ");
   log(enabled ? "Enabled " : "Disabled ");
   log(" the Bluetooth Module, the new value takes effect after restarting the module.\n");
+  return status;
 }
 
-inline static MacAddress Command_GetMacAddress()
-{
-  const Command GetMacAddress = {
-    .Word = {0xA5, 0x00},
-    .Size = 2,
-    .Values = {0x01, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+// All zeros if the radar didn't answer
+template<typename Transport>
+inline static MacAddress Command_GetMacAddress(Transport& port)
+{
+  log("Getting MAC Address \n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command response;
+  MacAddress result = {};
+
+  if(SendFrameAndWaitForACK<GetMacAddressFrame>(port, &response) != CommandResult_Ok)
+  {
+    log("Failed to get MAC\n");
+    return result;
+  }
+
+  // FD FC FB FA | 0A 00 | A5 01 | 00 00 | 8F 27 2E B8 0F 65 | EOF
+  log("Current MAC Address: ");
+  for(int i = 4; i < 10; i++)
+  {
+    unsigned int c = response.Values[i];
+    log(c);
+    log(' ');
+    result.Bytes[i-4] = c;
+  }
+
+  endline();
+
+  return result;
+}
+
+// All zeros if the radar didn't answer, must be in configuration mode
+template<typename Transport>
+inline static ZoneConfiguration Command_GetZoneConfiguration(Transport& port)
+{
+  log("Getting Zone Configuration \n");
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command response;
+  ZoneConfiguration result = {};
+  if(SendFrameAndWaitForACK<GetZoneConfigurationFrame>(port, &response) != CommandResult_Ok || response.Size < 4 + ZONE_CONFIGURATION_SIZE)
+  {
+    log("Failed to get zone configuration\n");
+    return result;
+  }
+
+  // HEADER      | size  | comm  | null  | type  | zone1 xy/xy               | zone2 xy/xy   | zone3 xy/xy
+  // FD FC FB FA | 1E 00 | C1 01 | 00 00 | 01 00 | E803 E803 18FC 8813 | 0000 0000 0000 0000 | 0000 0000 0000 0000 | EOF
+  // ............|.......| 0  1  | 2  3  | 4  5  | 6
+  result = DecodeZoneConfiguration(response.Values + 4);
+
+  struct RadarLink* link = LinkOf(port);
+  link->Zones = result;
+  link->ZonesKnown = true;
+
+  return result;
+}
+
+// Writes all three zones, must be in configuration mode
+template<typename Transport>
+inline static CommandResult Command_SetZoneConfiguration(Transport& port, const ZoneConfiguration* config)
+{
+  log("Setting Zone Configuration \n");
+  // FD FC FB FA | 1C 00 | C2 00 | type | zone1 | zone2 | zone3 | EOF
+  Command command = {};
+  command.Word[0] = SET_ZONE_CONFIGURATION_WORD;
+  command.Size = ZONE_CONFIGURATION_SIZE;
+  EncodeZoneConfiguration(config, command.Values);
+
+  // Return Value: 2 byte ACK status (0 success, 1 failure)
+  Command response;
+  const CommandResult status = SendCommandAndWaitForACK(port, &command, &response);
+
+  struct RadarLink* link = LinkOf(port);
+  if(status != CommandResult_Ok)
+  {
+    // the radar may or may not have taken it
+    link->ZonesKnown = false;
+    log("Failed to set zone configuration\n");
+    return status;
+  }
+
+  link->Zones = *config;
+  link->ZonesKnown = true;
+  return status;
+}
+
+// Zone configuration from the shadow copy, only goes to the radar (through configuration mode)
+// the first time or when refresh is set
+template<typename Transport>
+inline static CommandResult GetZoneFiltering(Transport& port, ZoneConfiguration* out, bool refresh)
+{
+  struct RadarLink* link = LinkOf(port);
+  if(link->ZonesKnown && !refresh)
+  {
+    *out = link->Zones;
+    return CommandResult_Ok;
+  }
+
+  CommandResult status = Command_EnableConfigMode(port);
+  if(status == CommandResult_Ok)
+  {
+    link->ZonesKnown = false;
+    Command_GetZoneConfiguration(port);
+    status = link->ZonesKnown ? CommandResult_Ok : CommandResult_Timeout;
+  }
+  Command_DisableConfigMode(port);
+
+  *out = link->Zones;
+  return status;
+}
+
+// Pushes zone filtering into the radar so excluded targets never reach the host
+// does nothing when config matches what the radar is known to have
+template<typename Transport>
+inline static CommandResult SetZoneFiltering(Transport& port, const ZoneConfiguration* config)
+{
+  struct RadarLink* link = LinkOf(port);
+  if(link->ZonesKnown && ZoneConfigurationEquals(&link->Zones, config))
+  {
+    return CommandResult_Ok;
+  }
+
+  CommandResult status = Command_EnableConfigMode(port);
+  if(status == CommandResult_Ok)
+  {
+    status = Command_SetZoneConfiguration(port, config);
+  }
+  Command_DisableConfigMode(port);
+
+  return status;
+}
+
+// How many commands a ConfigSession can queue
+#ifndef CONFIG_SESSION_MAX_COMMANDS
+#define CONFIG_SESSION_MAX_COMMANDS 8
+#endif
+
+// Command buffer size the radar reports in its enable configuration ACK
+// used until the real value is known
+#define DEFAULT_RADAR_COMMAND_BUFFER_SIZE 64
+
+typedef enum ConfigStatus{
+  // Not sent or not acknowledged yet
+  ConfigStatus_Pending = 0x0,
+  // ACK status 0
+  ConfigStatus_Ok = 0x1,
+  // ACK status was not 0
+  ConfigStatus_Failed = 0x2,
+  // No ACK arrived in time
+  ConfigStatus_NoResponse = 0x3
+} ConfigStatus;
+
+typedef struct ConfigSessionCommand{
+  // CommandFrame bytes, Value is patched in at COMMAND_FRAME_VALUE_OFFSET when HasValue is set
+  const uint8_t* Frame;
+  uint8_t Length;
+  uint8_t Status;
+  bool HasValue;
+  uint16_t Value;
+  // Optional, receives the whole ACK for commands that read something
+  struct Command* Response;
+  // Sends so far and when the first one went out, bounded by the session's CommandPolicy
+  uint8_t Attempts;
+  unsigned long FirstSent_ms;
+} ConfigSessionCommand;
+
+// Groups several configuration changes into one trip through configuration mode
+// Enables configuration mode when constructed, pipelines queued commands as far as the
+// radar's command buffer allows when applied and always disables configuration mode
+// when it goes out of scope, even if a command failed
+// Each command gets the retries and deadline of policy, the same as when it is sent on its own.
+// A command that fails is sent again along with the ones queued after it that were already in
+// flight, so they still take effect in order. A restart is only sent once everything before it
+// is acknowledged, the radar takes no more commands after it.
+//
+//   {
+//     ConfigSession<PosixTransport> session(port);
+//     session.SetMultiTargetTracking();
+//     session.SetBaudRate(b460800);
+//     session.SetEnableBluetooth(false);
+//     if(!session.Apply()) { ... session.Commands[i].Status ... }
+//   } // configuration mode disabled here
+template<typename Transport>
+struct ConfigSession{
+  Transport* Port;
+  bool Enabled;
+  CommandResult EnableResult;
+  // bytes the radar can buffer, from the enable configuration ACK
+  uint16_t RadarBufferSize;
+  uint8_t Count;
+  // Commands[0..Applied) have a final Status
+  uint8_t Applied;
+  ConfigSessionCommand Commands[CONFIG_SESSION_MAX_COMMANDS];
+  const struct CommandPolicy* Policy;
+
+  ConfigSession(Transport& port, const struct CommandPolicy* policy = &DefaultCommandPolicy) : Port(&port), Enabled(false), EnableResult(CommandResult_Timeout), RadarBufferSize(DEFAULT_RADAR_COMMAND_BUFFER_SIZE), Count(0), Applied(0), Policy(policy)
+  {
+    Begin();
+  }
+
+  // Only one of them may disable configuration mode
+  ConfigSession(const ConfigSession&) = delete;
+  ConfigSession& operator=(const ConfigSession&) = delete;
+
+  ~ConfigSession()
+  {
+    End();
+  }
+
+  bool Begin()
+  {
+    if(Enabled)
+    {
+      return true;
+    }
+
+    log("Requesting Configuration Mode\n");
+    Command ack;
+    memset(&ack, 0, sizeof(ack));
+    EnableResult = ExecuteCommand(*Port, EnableConfigModeFrame::Bytes, sizeof(EnableConfigModeFrame::Bytes), &ack, Policy);
+
+    // ACK data: FF 01 | status | protocol version | buffer size
+    if(ack.Size >= 8 && ack.Values[0] == 0xFF)
+    {
+      const uint16_t bufferSize = ack.Values[6] | (ack.Values[7] << 8);
+      if(bufferSize >= sizeof(ACKHeader) + 2 + 2 + sizeof(ACKEndOfFrame))
+      {
+        RadarBufferSize = bufferSize;
+      }
+    }
+
+    // even without an ACK the radar may have switched, End still has to switch it back
+    Enabled = true;
+    return EnableResult == CommandResult_Ok;
+  }
+
+  // Queues a complete frame, frame must stay valid until Apply
+  bool Queue(const uint8_t* frame, size_t length, struct Command* response = NULL)
+  {
+    if(Count >= CONFIG_SESSION_MAX_COMMANDS || length > MAX_FRAME_SIZE)
+    {
+      log("Config session full\n");
+      return false;
+    }
+
+    ConfigSessionCommand* command = &Commands[Count++];
+    command->Frame = frame;
+    command->Length = length;
+    command->Status = ConfigStatus_Pending;
+    command->HasValue = false;
+    command->Value = 0;
+    command->Response = response;
+    command->Attempts = 0;
+    command->FirstSent_ms = 0;
+    return true;
+  }
+
+  template<typename Frame>
+  bool Queue(struct Command* response = NULL)
+  {
+    return Queue(Frame::Bytes, sizeof(Frame::Bytes), response);
+  }
+
+  template<typename Frame>
+  bool QueueWithValue(uint16_t value, struct Command* response = NULL)
+  {
+    if(!Queue(Frame::Bytes, sizeof(Frame::Bytes), response))
+    {
+      return false;
+    }
+
+    Commands[Count - 1].HasValue = true;
+    Commands[Count - 1].Value = value;
+    return true;
+  }
+
+  bool SetSingleTargetTracking() { return Queue<SingleTargetTrackingFrame>(); }
+  bool SetMultiTargetTracking() { return Queue<MultiTargetTrackingFrame>(); }
+  bool ReadTrackingMode(struct Command* response) { return Queue<ReadTrackingModeFrame>(response); }
+  bool SetBaudRate(AvailableBaudRates baud) { return QueueWithValue<SetBaudRateFrame>(baud); }
+  bool SetEnableBluetooth(bool enabled) { return QueueWithValue<SetEnableBluetoothFrame>(enabled ? 0x0001 : 0x0000); }
+  bool GetMacAddress(struct Command* response) { return Queue<GetMacAddressFrame>(response); }
+  bool ResetToFactorySettings()
+  {
+    // zones go back to defaults, the shadow copy has to be read again
+    LinkOf(*Port)->ZonesKnown = false;
+    return Queue<ResetToFactorySettingsFrame>();
+  }
+  bool RestartModule() { return Queue<RestartModuleFrame>(); }
+
+  // Sends every queued command not sent yet, keeping as many in flight as fit in the
+  // radar's command buffer, and collects their ACKs in order
+  // returns true if every command in the session succeeded
+  bool Apply()
+  {
+    uint8_t sent = Applied;
+    size_t inFlight = 0;
+
+    // nothing will be acknowledged outside configuration mode
+    if(EnableResult != CommandResult_Ok)
+    {
+      for(; Applied < Count; ++Applied)
+      {
+        Commands[Applied].Status = ConfigStatus_NoResponse;
+      }
+      return false;
+    }
+
+    while(Applied < Count)
+    {
+      while(sent < Count && _CanSend(sent, inFlight))
+      {
+        _Send(&Commands[sent]);
+        inFlight += Commands[sent].Length;
+        sent++;
+      }
+
+      _Acknowledge(sent);
+      ConfigSessionCommand* command = &Commands[Applied];
+      if(command->Status != ConfigStatus_Ok && _CanRetry(command))
+      {
+        const uint8_t word = command->Frame[COMMAND_FRAME_VALUE_OFFSET - 2];
+        log_event(LogEvent_Retry, word, command->Attempts);
+        stats_update(LinkOf(*Port)->Stats.Retries[RadarStats_Slot(word)]++);
+        _Rewind(sent);
+        sent = Applied;
+        inFlight = 0;
+        continue;
+      }
+
+      inFlight -= command->Length;
+      Applied++;
+    }
+
+    return Succeeded();
+  }
+
+  bool Succeeded() const
+  {
+    for(uint8_t i = 0; i < Count; ++i)
+    {
+      if(Commands[i].Status != ConfigStatus_Ok)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Applies anything still queued then disables configuration mode
+  bool End()
+  {
+    if(!Enabled)
+    {
+      return Succeeded();
+    }
+
+    const bool result = Apply();
+
+    Command_DisableConfigMode(*Port);
+    Enabled = false;
+
+    return result;
+  }
+
+  bool _CanSend(uint8_t index, size_t inFlight) const
+  {
+    const ConfigSessionCommand* command = &Commands[index];
+    const bool restart = command->Frame[COMMAND_FRAME_VALUE_OFFSET - 2] == RestartModuleFrame::Bytes[COMMAND_FRAME_VALUE_OFFSET - 2];
+    return index == Applied || (!restart && inFlight + command->Length <= RadarBufferSize);
+  }
+
+  bool _CanRetry(const ConfigSessionCommand* command)
+  {
+    return command->Attempts <= Policy->MaxRetries && Port->Millis() - command->FirstSent_ms <= Policy->Deadline_ms;
+  }
+
+  // Commands[Applied] is about to be sent again, the ones after it that are still in flight
+  // ran before it so they go again too: their ACKs are let through and their sends not counted
+  void _Rewind(uint8_t sent)
+  {
+    uint8_t outstanding = sent - Applied - 1;
+    if(_HasPendingAck)
+    {
+      _HasPendingAck = false;
+      outstanding--;
+    }
+
+    unsigned long last = Port->Millis();
+    struct Command frame;
+    while(outstanding > 0 && Port->Millis() - last <= Policy->AckTimeout_ms)
+    {
+      const FrameType type = _TryReadFrame(*Port, &frame);
+      if(type == FrameType_None)
+      {
+        Port->Delay(1);
+        continue;
+      }
+      if(type == FrameType_ACK)
+      {
+        outstanding--;
+        last = Port->Millis();
+      }
+    }
+
+    for(uint8_t i = Applied + 1; i < sent; ++i)
+    {
+      Commands[i].Attempts--;
+      Commands[i].Status = ConfigStatus_Pending;
+    }
+  }
+
+  void _Send(ConfigSessionCommand* command)
+  {
+    if(command->Attempts++ == 0)
+    {
+      command->FirstSent_ms = Port->Millis();
+    }
+
+    if(!command->HasValue)
+    {
+      SendFrame(*Port, command->Frame, command->Length);
+      return;
+    }
+
+    uint8_t frame[MAX_FRAME_SIZE];
+    memcpy(frame, command->Frame, command->Length);
+    frame[COMMAND_FRAME_VALUE_OFFSET] = command->Value & 0xFF;
+    frame[COMMAND_FRAME_VALUE_OFFSET + 1] = command->Value >> 8;
+    SendFrame(*Port, frame, command->Length);
+  }
+
+  // Waits for the ACK of Commands[Applied], an ACK for a later command means the radar
+  // dropped this one so it is marked NoResponse and the ACK is kept for the next call
+  void _Acknowledge(uint8_t sent)
+  {
+    ConfigSessionCommand* command = &Commands[Applied];
+    const uint8_t word = command->Frame[COMMAND_FRAME_VALUE_OFFSET - 2];
+
+    if(_HasPendingAck && _PendingAck.Values[0] != word)
+    {
+      command->Status = ConfigStatus_NoResponse;
+      return;
+    }
+
+    const unsigned long start = Port->Millis();
+    while(!_HasPendingAck)
+    {
+      if(Port->Millis() - start > Policy->AckTimeout_ms)
+      {
+        log_event(LogEvent_AckTimeout, word, 0);
+        stats_update(LinkOf(*Port)->Stats.Timeouts[RadarStats_Slot(word)]++);
+        command->Status = ConfigStatus_NoResponse;
+        return;
+      }
+
+      const FrameType type = _TryReadFrame(*Port, &_PendingAck);
+      if(type == FrameType_None)
+      {
+        Port->Delay(1);
+        continue;
+      }
+
+      // radar data still trickling in, kept for TryReadCommand
+      if(type != FrameType_ACK || _PendingAck.Size < 4)
+      {
+        continue;
+      }
+
+      _HasPendingAck = true;
+      if(_PendingAck.Values[0] != word)
+      {
+        // ACK for a command we haven't sent is junk, otherwise ours was dropped
+        bool later = false;
+        for(uint8_t i = Applied + 1; i < sent; ++i)
+        {
+          later |= Commands[i].Frame[COMMAND_FRAME_VALUE_OFFSET - 2] == _PendingAck.Values[0];
+        }
+
+        if(!later)
+        {
+          _HasPendingAck = false;
+          continue;
+        }
+
+        command->Status = ConfigStatus_NoResponse;
+        return;
+      }
+    }
+
+    _HasPendingAck = false;
+    command->Status = (_PendingAck.Values[2] == 0 && _PendingAck.Values[3] == 0) ? ConfigStatus_Ok : ConfigStatus_Failed;
+    if(command->Response)
+    {
+      *command->Response = _PendingAck;
+    }
+  }
+
+  bool _HasPendingAck = false;
+  struct Command _PendingAck;
+};
+
+template<typename Transport>
+inline static void SendCommand(Transport& port, const struct Command* command)
+{
+  uint8_t frame[MAX_FRAME_SIZE];
+  const size_t length = EncodeCommand(command, frame, sizeof(frame));
+  if(length == 0)
+  {
+    log("Attempted to send command larger than this program supports: ");
+    log(command->Size);
+    endline();
+    return;
+  }
+
+  SendFrame(port, frame, length);
+}
+
+// Mutates expectedAndOut's Value array with the response data (expectedAndOut->Values)
+// Waits at most timeout_ms in total, frames that don't match are skipped in a loop rather than by recursing
+template<typename Transport>
+inline static void WaitForCommand(Transport& port, struct Command* expectedAndOut, bool allowMalformed, size_t timeout_ms, bool timeoutIsSuccess, bool radarResumeIsSuccess)
+{
+  const unsigned long start = port.Millis();
+
+  while(true)
+  {
+    const unsigned long elapsed = port.Millis() - start;
+    struct Command result = ReadCommand(port, elapsed < timeout_ms ? timeout_ms - elapsed : 0);
+
+    if(result.Word[0] == 0xAA && result.Word[1] == 0xFF && radarResumeIsSuccess)
+    {
+      _MimicSuccessfulACK(expectedAndOut, expectedAndOut->Word[0]);
+      return;
+    }
+
+    if(result.TimedOut)
+    {
+      log_event(LogEvent_AckTimeout, expectedAndOut->Word[0], 0);
+      stats_update(LinkOf(port)->Stats.Timeouts[RadarStats_Slot(expectedAndOut->Word[0])]++);
+
+      if(timeoutIsSuccess == false)
+      {
+        expectedAndOut->Malformed = true;
+        expectedAndOut->TimedOut = true;
+        return;
+      }
+
+      _MimicSuccessfulACK(expectedAndOut, expectedAndOut->Word[0]);
+      return;
+    }
+
+    if(result.Malformed && !allowMalformed)
+    {
+      log_event(LogEvent_Malformed, result.Word[0], result.Size);
+      continue;
+    }
+
+    const bool correctResponse = result.Word[0] == expectedAndOut->Word[0] && result.Word[1] == expectedAndOut->Word[1];
+    if(!correctResponse)
+    {
+      log_event(LogEvent_WrongAck, expectedAndOut->Word[0], result.Word[0]);
+      continue;
+    }
+
+    log_event(LogEvent_Frame, result.Word[0], result.Size);
+
+    expectedAndOut->Size = result.Size;
+    memcpy(expectedAndOut->Values, result.Values, result.Size);
+    return;
+  }
+}
+
+inline static void FrameParser_Init(struct FrameParser* parser, FrameCallback onFrame, void* context)
+{
+  memset(parser, 0, sizeof(struct FrameParser));
+  parser->OnFrame = onFrame;
+  parser->Context = context;
+}
+
+// Starts matching a new header with the given byte, returns false if the byte can't start a frame
+inline static bool _FrameParser_Restart(struct FrameParser* parser, uint8_t byte)
+{
+  parser->State = FrameParserState_Header;
+  parser->Index = 0;
+  parser->Type = FrameType_None;
+
+  // a mismatched byte may well be the start of the next frame, the radar
+  // will happily stop halfway through position data to send an ACK
+  if(byte == RadarHeader[0])
+  {
+    parser->Type = FrameType_Radar;
+  }
+  else if(byte == ACKHeader[0])
+  {
+    parser->Type = FrameType_ACK;
+  }
+  else
+  {
+    stats_update(parser->Stats.Discarded++);
+    return false;
+  }
+
+  parser->Index = 1;
+  return true;
+}
+
+typedef enum _FrameParserStep{
+  _FrameParserStep_Byte = 0x0,
+  // Frame holds a complete frame
+  _FrameParserStep_Frame = 0x1,
+  // The length or end of frame didn't match, the parser still holds what it had consumed
+  // so the caller can rescan it for the next header, see _FrameParser_Rescan
+  _FrameParserStep_Abandoned = 0x2
+} _FrameParserStep;
+
+// Offset of the first AA or FD in bytes, the only bytes a frame can start with, length if there is none
+// A word at a time off AVR: (v - 0x0101..) & ~v & 0x8080.. is non zero exactly when v has a zero
+// byte, so xor'ing the word with each start byte first finds a candidate anywhere in the word
+inline static size_t _FindFrameStart(const uint8_t* bytes, size_t length)
+{
+  size_t i = 0;
+#if !defined(__AVR__)
+  // 32 or 64 bits, whatever the target does in one load
+  typedef unsigned long Word;
+  const Word ones = (Word)-1 / 0xFF;
+  const Word highs = ones << 7;
+  const Word radar = ones * RadarHeader[0];
+  const Word ack = ones * ACKHeader[0];
+  for(; i + sizeof(Word) <= length; i += sizeof(Word))
+  {
+    Word word;
+    memcpy(&word, bytes + i, sizeof(Word));
+    const Word r = word ^ radar;
+    const Word a = word ^ ack;
+    if((((r - ones) & ~r) | ((a - ones) & ~a)) & highs)
+    {
+      break;
+    }
+  }
+#endif
+  while(i < length && bytes[i] != RadarHeader[0] && bytes[i] != ACKHeader[0])
+  {
+    i++;
+  }
+  return i;
+}
+
+// False when bytes can't be the start of a frame: the header is wrong, or the whole frame is
+// already buffered and its end of frame is not where the length says it is. Checking before
+// committing keeps a stray AA or FD from swallowing the bytes of the real frame behind it.
+inline static bool _FrameParser_Plausible(const uint8_t* bytes, size_t length)
+{
+  const bool isRadar = bytes[0] == RadarHeader[0];
+  const uint8_t* header = isRadar ? RadarHeader : ACKHeader;
+  if(memcmp(bytes, header, length < sizeof(RadarHeader) ? length : sizeof(RadarHeader)) != 0)
+  {
+    return false;
+  }
+
+  if(isRadar)
+  {
+    return length < RADAR_FRAME_SIZE || memcmp(bytes + RADAR_FRAME_SIZE - sizeof(RadarEndOfFrame), RadarEndOfFrame, sizeof(RadarEndOfFrame)) == 0;
+  }
+
+  if(length < sizeof(ACKHeader) + 2)
+  {
+    return true;
+  }
+
+  const size_t size = bytes[4] | (bytes[5] << 8);
+  if(size > MAX_FRAME_DATA_SIZE)
+  {
+    return false;
+  }
+
+  const size_t end = sizeof(ACKHeader) + 2 + size;
+  return length < end + sizeof(ACKEndOfFrame) || memcmp(bytes + end, ACKEndOfFrame, sizeof(ACKEndOfFrame)) == 0;
+}
+
+inline static _FrameParserStep _FrameParser_Step(struct FrameParser* parser, uint8_t byte)
+{
+  const bool isRadar = parser->Type == FrameType_Radar;
+
+  switch(parser->State)
+  {
+    case FrameParserState_Header:
+    {
+      if(parser->Index == 0)
+      {
+        _FrameParser_Restart(parser, byte);
+        break;
+      }
+
+      // a header never contains its own first byte again, so nothing matched so far can start a frame
+      const uint8_t* header = isRadar ? RadarHeader : ACKHeader;
+      if(byte != header[parser->Index])
+      {
+        log_event(LogEvent_HeaderMismatch, header[parser->Index], byte);
+        stats_update(parser->Stats.HeaderMismatches[isRadar ? STATS_FRAME_RADAR : STATS_FRAME_ACK]++);
+        stats_update(parser->Stats.Discarded += parser->Index);
+        _FrameParser_Restart(parser, byte);
+        break;
+      }
+
+      if(++parser->Index < 4)
+      {
+        break;
+      }
+
+      parser->Index = 0;
+      parser->Frame.Malformed = false;
+      parser->Frame.TimedOut = false;
+      if(isRadar)
+      {
+        parser->Frame.Word[0] = 0xAA;
+        parser->Frame.Word[1] = 0xFF;
+        parser->Frame.Size = RADAR_FRAME_DATA_SIZE;
+        parser->State = FrameParserState_Payload;
+      }
+      else
+      {
+        parser->Frame.Word[0] = 0xFD;
+        parser->Frame.Word[1] = 0xFC;
+        parser->Frame.Size = 0;
+        parser->State = FrameParserState_Length;
+      }
+      break;
+    }
+    case FrameParserState_Length:
+      // little endian, nothing we handle needs the high byte
+      if(parser->Index == 0)
+      {
+        parser->Frame.Size = byte;
+        parser->Index++;
+        break;
+      }
+
+      if(byte != 0 || parser->Frame.Size > MAX_FRAME_DATA_SIZE)
+      {
+        log_event(LogEvent_FrameTooLarge, 0, parser->Frame.Size | (byte << 8));
+        stats_update(parser->Stats.TooLarge++);
+        return _FrameParserStep_Abandoned;
+      }
+
+      parser->Index = 0;
+      parser->State = parser->Frame.Size == 0 ? FrameParserState_EndOfFrame : FrameParserState_Payload;
+      break;
+    case FrameParserState_Payload:
+      parser->Frame.Values[parser->Index] = byte;
+      if(++parser->Index == parser->Frame.Size)
+      {
+        parser->Index = 0;
+        parser->State = FrameParserState_EndOfFrame;
+      }
+      break;
+    case FrameParserState_EndOfFrame:
+    {
+      const uint8_t* endOfFrame = isRadar ? RadarEndOfFrame : ACKEndOfFrame;
+      const uint8_t endOfFrameSize = isRadar ? sizeof(RadarEndOfFrame) : sizeof(ACKEndOfFrame);
 
-  log("Getting MAC Address \n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command response = SendCommandAndWaitForACK(&GetMacAddress);
+      if(byte != endOfFrame[parser->Index])
+      {
+        log_event(LogEvent_EndMismatch, endOfFrame[parser->Index], byte);
+        stats_update(parser->Stats.EndMismatches[isRadar ? STATS_FRAME_RADAR : STATS_FRAME_ACK]++);
+        return _FrameParserStep_Abandoned;
+      }
+
+      if(++parser->Index < endOfFrameSize)
+      {
+        break;
+      }
 
-  if(response.Values[2] != 0x0 || response.Values[3] != 0x0)
+      stats_update(parser->Stats.Frames[isRadar ? STATS_FRAME_RADAR : STATS_FRAME_ACK]++);
+      parser->State = FrameParserState_Header;
+      parser->Index = 0;
+      parser->Type = FrameType_None;
+      return _FrameParserStep_Frame;
+    }
+  }
+
+  return _FrameParserStep_Byte;
+}
+
+// Hands a complete frame to the callback, or keeps it for FrameParser_Poll and returns true
+inline static bool _FrameParser_Deliver(struct FrameParser* parser)
+{
+  if(parser->OnFrame)
   {
-    log("Failed to get MAC, retrying\n");
-    return Command_GetMacAddress();
+    parser->OnFrame(&parser->Frame, parser->Context);
+    return false;
   }
 
-  MacAddress result;
+  parser->Ready = true;
+  return true;
+}
 
-  log("Current MAC Address: ");
-  for(int i = 4; i < 9; i++)
+// Bytes of the current frame before the one being parsed, header and length included
+inline static size_t _FrameParser_Consumed(const struct FrameParser* parser)
+{
+  const size_t header = sizeof(ACKHeader) + (parser->Type == FrameType_Radar ? 0 : 2);
+  switch(parser->State)
   {
-    unsigned int c = response.Values[i];
-    log(c);
-    log(' ');
-    result.Bytes[i-4] = c;
+    case FrameParserState_Header:
+      return parser->Index;
+    case FrameParserState_Length:
+      return sizeof(ACKHeader) + parser->Index;
+    case FrameParserState_Payload:
+      return header + parser->Index;
+    case FrameParserState_EndOfFrame:
+    default:
+      return header + parser->Frame.Size + parser->Index;
   }
+}
 
-  endline();
+// Copies the bytes of an abandoned frame that may hold the next header into pending, i.e.
+// everything after the header (and length of an ACK) followed by the byte that broke it
+inline static size_t _FrameParser_Abandoned(const struct FrameParser* parser, uint8_t byte, uint8_t* pending)
+{
+  size_t count = 0;
+  if(parser->State == FrameParserState_Length)
+  {
+    pending[count++] = parser->Frame.Size;
+  }
+  else
+  {
+    const uint8_t* endOfFrame = parser->Type == FrameType_Radar ? RadarEndOfFrame : ACKEndOfFrame;
+    memcpy(pending, parser->Frame.Values, parser->Frame.Size);
+    count = parser->Frame.Size;
+    memcpy(pending + count, endOfFrame, parser->Index);
+    count += parser->Index;
+  }
 
-  return result;
+  pending[count++] = byte;
+  return count;
 }
 
-inline static ZoneConfiguration Command_GetZoneConfiguration()
+// Rescans what an abandoned frame had consumed instead of dropping all of it, a frame cut
+// short by a lost byte usually has the next header sitting in its payload, this way only the
+// damaged frame is lost. Returns true when a frame was left for FrameParser_Poll.
+inline static bool _FrameParser_Rescan(struct FrameParser* parser, uint8_t byte)
 {
-  log("Command_GetZoneConfiguration Not Implemented\n");
-  return {};
-  const Command GetZoneConfig = {
-    .Word = {0xC1, 0x00},
-    .Size = 0,
-    .Values = {0x00, 0x00},
-    .Malformed = false,
-    .TimedOut = false
-  };
+  uint8_t pending[MAX_FRAME_DATA_SIZE + sizeof(ACKEndOfFrame) + 1];
+  const size_t count = _FrameParser_Abandoned(parser, byte, pending);
+  stats_update(parser->Stats.Discarded += sizeof(ACKHeader) + (parser->Type == FrameType_Radar ? 0 : 2));
 
-  log("Getting Zone Configuration \n");
-  // Return Value: 2 byte ACK status (0 success, 1 failure)
-  Command response = SendCommandAndWaitForACK(&GetZoneConfig);
+  parser->State = FrameParserState_Header;
+  parser->Index = 0;
+  parser->Type = FrameType_None;
 
-  if(response.Values[2] != 0x0 || response.Values[3] != 0x0)
+  for(size_t i = 0; i < count; i++)
   {
-    log("Failed to get zone configuration, retrying\n");
-    return Command_GetZoneConfiguration();
+    const _FrameParserStep step = _FrameParser_Step(parser, pending[i]);
+    if(step == _FrameParserStep_Abandoned)
+    {
+      // damaged twice within one frame, drop it without rescanning again so this stays bounded
+      stats_update(parser->Stats.Discarded += _FrameParser_Consumed(parser));
+      _FrameParser_Restart(parser, pending[i]);
+      continue;
+    }
+
+    if(step == _FrameParserStep_Frame && _FrameParser_Deliver(parser))
+    {
+      // only one frame can wait for FrameParser_Poll, the rest of the rescan is lost
+      stats_update(parser->Stats.Discarded += count - i - 1);
+      return true;
+    }
   }
 
-  ZoneConfiguration result;
-  // HEADER      | size  | comm  | null  | type  | zone1 xy/xy               | zone2 xy/xy   | zone3 xy/xy
-  // FD FC FB FA | 1E 00 | C1 01 | 00 00 | 01 00 | E803 E803 18FC 8813 | 0000 0000 0000 0000 | 0000 0000 0000 0000 | EOF
-  // ............|.......| 0  1  | 2  3  | 4  5  | 6
-  result.Type = (ZoneFilteringType)response.Values[4];
+  return false;
+}
 
-  //result.Zone1.Start.X = response.Values[4]
+// Returns the number of bytes consumed, stops right after a complete frame when no
+// callback is set so the frame can be picked up with FrameParser_Poll before feeding the rest
+// Between frames everything that can't start one is skipped in a single step
+inline static size_t FrameParser_Feed(struct FrameParser* parser, const uint8_t* bytes, size_t length)
+{
+  if(parser->Ready)
+  {
+    return 0;
+  }
 
+  size_t i = 0;
+  while(i < length)
+  {
+    if(parser->State == FrameParserState_Header && parser->Index == 0)
+    {
+      const size_t skipped = _FindFrameStart(bytes + i, length - i);
+      stats_update(parser->Stats.Discarded += skipped);
+      i += skipped;
+      if(i == length)
+      {
+        break;
+      }
 
-  return result;
+      if(!_FrameParser_Plausible(bytes + i, length - i))
+      {
+        stats_update(parser->Stats.Discarded++);
+        i++;
+        continue;
+      }
+    }
+
+    const uint8_t byte = bytes[i++];
+    const _FrameParserStep step = _FrameParser_Step(parser, byte);
+    if(step == _FrameParserStep_Abandoned)
+    {
+      if(_FrameParser_Rescan(parser, byte))
+      {
+        return i;
+      }
+      continue;
+    }
+
+    if(step == _FrameParserStep_Frame && _FrameParser_Deliver(parser))
+    {
+      return i;
+    }
+  }
+
+  return length;
 }
 
-inline static void SendCommand(const struct Command* command)
+// Copies out the last complete frame, returns false if there is none
+inline static bool FrameParser_Poll(struct FrameParser* parser, struct Command* out)
 {
-  if(command->Size >= 32)
+  if(!parser->Ready)
   {
-    Serial.print("Attempted to send command larger than this program supports: ");
-    Serial.print(command->Size);
-    Serial.print('\n');
-    return;
+    return false;
   }
 
-  log("Sending: ");
+  *out = parser->Frame;
+  parser->Ready = false;
+  return true;
+}
+
+// How many bytes can be fed without running past the end of the current frame
+// reading exactly this many means FrameParser_Feed never has left over bytes
+inline static size_t FrameParser_Needed(const struct FrameParser* parser)
+{
+  const bool isRadar = parser->Type == FrameType_Radar;
+
+  switch(parser->State)
+  {
+    case FrameParserState_Header:
+      // up to the end of the shortest frame that could be starting, if this one turns
+      // out not to be a frame no other one can start and end inside those bytes
+      return MIN_FRAME_SIZE - parser->Index;
+    case FrameParserState_Length:
+      return 2 - parser->Index + sizeof(ACKEndOfFrame);
+    case FrameParserState_Payload:
+      return parser->Frame.Size - parser->Index + (isRadar ? sizeof(RadarEndOfFrame) : sizeof(ACKEndOfFrame));
+    case FrameParserState_EndOfFrame:
+    default:
+      return (isRadar ? sizeof(RadarEndOfFrame) : sizeof(ACKEndOfFrame)) - parser->Index;
+  }
+}
 
+// Writes the complete frame for command into buffer, returns its length
+// or 0 if it does not fit in capacity
+inline static size_t EncodeCommand(const struct Command* command, uint8_t* buffer, size_t capacity)
+{
   //Header       In-frame data length In-frame data End of frame
   // FD FC FB FA 2 bytes              See Table 3   04 03 02 01
+  const size_t dataSize = command->Size + 2;
+  const size_t length = sizeof(ACKHeader) + 2 + dataSize + sizeof(ACKEndOfFrame);
+  if(dataSize > MAX_FRAME_DATA_SIZE || length > capacity)
+  {
+    return 0;
+  }
 
-  // send header
-  write_char(0xFD);
-  write_char(0xFC);
-  write_char(0xFB);
-  write_char(0xFA);
+  memcpy(buffer, ACKHeader, sizeof(ACKHeader));
+  buffer += sizeof(ACKHeader);
 
-  // Send Data Size
-  write_char(command->Size + 2);
-  write_char(0x00);
-  
-  write_char(command->Word[0]);
-  write_char(command->Word[1]);
+  *buffer++ = dataSize;
+  *buffer++ = 0x00;
+  *buffer++ = command->Word[0];
+  *buffer++ = command->Word[1];
 
-  for(uint16_t i = 0; i < command->Size; i++)
-  {
-    write_char(command->Values[i]);
-  }
+  memcpy(buffer, command->Values, command->Size);
+  buffer += command->Size;
 
-  // Send End Of Frame
-  write_char(0x04);
-  write_char(0x03);
-  write_char(0x02);
-  write_char(0x01);
+  memcpy(buffer, ACKEndOfFrame, sizeof(ACKEndOfFrame));
 
-  endline();
+  return length;
 }
 
-// Mutates expectedAndOut's Value array with the response data (expectedAndOut->Values)
-inline static void WaitForCommand(struct Command* expectedAndOut, bool allowMalformed, size_t timeout_ms, bool timeoutIsSuccess = false, bool radarResumeIsSuccess = false)
+// Parses the first complete frame in bytes into out
+// returns the number of bytes up to and including its end or 0 if there is no complete frame
+inline static size_t ParseFrame(const uint8_t* bytes, size_t length, struct Command* out)
 {
-  struct Command result = ReadCommand(timeout_ms);
-  
-  if(result.Word[0] == 0xAA && result.Word[1] == 0xFF && radarResumeIsSuccess)
-  {
-    // Mimic valid response since the radar decides to just resume the radar instead of sending valid data
-    expectedAndOut->Size = 4;
-    expectedAndOut->Values[0] = expectedAndOut->Word[0];
-    expectedAndOut->Values[1] = 0x01;
-    expectedAndOut->Values[2] = 0x0;
-    expectedAndOut->Values[3] = 0x0;
-    expectedAndOut->Values[4] = 0x0;
-    return;
+  struct FrameParser parser;
+  FrameParser_Init(&parser);
+
+  const size_t consumed = FrameParser_Feed(&parser, bytes, length);
+  return FrameParser_Poll(&parser, out) ? consumed : 0;
+}
+
+// Never waits, pulls whatever the port has buffered into the parser and
+// returns true when a complete frame was written to out
+template<typename Transport>
+inline static bool TryReadCommand(Transport& port, struct Command* out)
+{
+  struct RadarLink* link = LinkOf(port);
+
+  // radar data that turned up while a command was waiting for its ACK
+  if(link->RadarPending)
+  {
+    *out = link->Radar;
+    link->RadarPending = false;
+    return true;
   }
 
-  const bool correctResponse = result.Word[0] == expectedAndOut->Word[0] && result.Word[1] == expectedAndOut->Word[1];
+  return _TryReadParsedFrame(port, out);
+}
+
+template<typename Transport>
+inline static bool _TryReadParsedFrame(Transport& port, struct Command* out)
+{
+  struct RadarLink* link = LinkOf(port);
+  struct FrameParser* parser = &link->Parser;
+  uint8_t buffer[MAX_FRAME_SIZE];
+  stats_update(const unsigned long start_us = port.Micros());
 
-  if(result.TimedOut)
+  while(!parser->Ready)
   {
-    log("T/O\n");
+    const size_t available = port.Available();
+    if(available == 0)
+    {
+      break;
+    }
 
-    if(timeoutIsSuccess == false)
+    // never read past the end of the current frame, that way the bytes
+    // after it stay in the transport instead of needing a home here
+    size_t count = FrameParser_Needed(parser);
+    if(count > available)
     {
-      return WaitForCommand(expectedAndOut, allowMalformed, timeout_ms, timeoutIsSuccess, radarResumeIsSuccess);
+      count = available;
+    }
+    if(count > sizeof(buffer))
+    {
+      count = sizeof(buffer);
     }
 
-    // Mimic valid response since the radar decides to just resume the radar instead of sending valid data
-    expectedAndOut->Size = 4;
-    expectedAndOut->Values[0] = expectedAndOut->Word[0];
-    expectedAndOut->Values[1] = 0x01;
-    expectedAndOut->Values[2] = 0x0;
-    expectedAndOut->Values[3] = 0x0;
-    expectedAndOut->Values[4] = 0x0;
+    count = port.Read(buffer, count);
+    if(count == 0)
+    {
+      break;
+    }
 
-    return result;
-  }
+    if(link->OnReceive != NULL)
+    {
+      link->OnReceive(buffer, count, port.Micros(), link->ReceiveContext);
+    }
 
-  if(result.Malformed && !allowMalformed)
-  {
-    log("MLF\n");
-    return WaitForCommand(expectedAndOut, allowMalformed, timeout_ms, timeoutIsSuccess, radarResumeIsSuccess);
+    log_event(LogEvent_Received, count, buffer[0] | (count > 1 ? buffer[1] << 8 : 0));
+    const size_t used = FrameParser_Feed(parser, buffer, count);
+    if(used < count)
+    {
+      // a rescan found a whole frame inside one that broke, the few bytes after it are too
+      // short to be another frame so they go straight back into the parser
+      FrameParser_Poll(parser, out);
+      FrameParser_Feed(parser, buffer + used, count - used);
+      stats_update(LatencyHistogram_Add(&link->Stats.DecodeTime, port.Micros() - start_us));
+      return true;
+    }
   }
 
-  if(!correctResponse)
+  if(!FrameParser_Poll(parser, out))
   {
-    log("WRG\n");
-    return WaitForCommand(expectedAndOut, allowMalformed, timeout_ms, timeoutIsSuccess, radarResumeIsSuccess);
+    return false;
   }
 
-  log("Received successful response: ");
-  log(result.Word[0],HEX);
-  log(' ');
-  log(result.Word[1],HEX);
-  log("  ");
-  for(int i = 0; i < 31; ++i)
-  {
-    const unsigned int c = result.Values[i];
-    log(c);
-    log(' ');
-    expectedAndOut->Values[i] = c;
-  }
-  endline();
+  stats_update(LatencyHistogram_Add(&link->Stats.DecodeTime, port.Micros() - start_us));
+  return true;
 }
 
-inline static struct Command ReadCommand(unsigned int timeout_ms = UINT_MAX)
+template<typename Transport>
+inline static auto ReadCommand(Transport& port, unsigned int timeout_ms) -> decltype(port.Available(), Command())
 {
-  const uint16_t HeaderStartACK = 0xFD;
-  const uint16_t HeaderStartRadar = 0xAA;
-
-  uint16_t __temporary_value;
-  #define enforce_read(expectedValue) __temporary_value = read_char(); if(__temporary_value != expectedValue){ if(__temporary_value == HeaderStartRadar){goto radar;} if(__temporary_value == HeaderStartACK){goto ack;}log("Expected: ");log(expectedValue, HEX);log(" Got: ");log(__temporary_value,HEX); result.Malformed = true; return result;}
-  
   struct Command result = {
     .Word = {0x00, 0x00},
     .Size = 0,
@@ -609,95 +2431,19 @@ inline static struct Command ReadCommand(unsigned int timeout_ms = UINT_MAX)
     .TimedOut = false
   };
 
-  // put your main code here, to run repeatedly:
-  unsigned int count = 0;
-  while(!Serial1.available()){
-    delay(1);
-    log(".");
-    if(count++>timeout_ms){
+  const unsigned long start = port.Millis();
+  while(!TryReadCommand(port, &result))
+  {
+    if(port.Millis() - start > timeout_ms)
+    {
       // technically its not malformed but we dont want to accidentally use the command
       // if it timed out
       result.Malformed = true;
       result.TimedOut = true;
       return result;
     }
-  }
-
-  log("Received: ");
-  uint16_t byte = read_char();
-
-  // configuration header:
-  // FD FC FB FA
-  if(byte == 0xFD)
-  {
-// GOTO justification:
-// Since we have no clock signal with UART Serial
-// And we have no control over communication timing
-// Theres a chance we send a command and receive the response in the middle of a different
-// reponse where the radar might begin sending radar position data but stop to send an ACK
-// So all enforce reads check failures against start headers and will jump to the corresponding
-// goto tags as needed this could be done through normal method
-// design but for some reason adding a stack frame maes it so we miss data even
-// though it should be buffered for us
-ack:
-    result.Word[0] = 0xFD;
-    result.Word[1] = 0xFC;
-
-    // throw away next 3 bytes
-    enforce_read(0xFC);
-    enforce_read(0xFB);
-    enforce_read(0xFA);
-
-    result.Size = read_char();
-    // throw away second byte of size we are little endian dont care
-    // because we're not likely to receive message greater than 32 bytes
-    read_char();
-
-    for(int i = 0; i < result.Size; ++i)
-    {
-      result.Values[i] = read_char();
-    }
-
-    // ensure we read the data correctly by verifying start of End of Frame
-    // EOF is 04 03 02 01
-    enforce_read(0x04);
-    enforce_read(0x03);
-    enforce_read(0x02);
-    enforce_read(0x01);
-
-  }else if(byte == 0xAA)
-  {
-radar:
-      // HEADER
-      // AA FF 03 00
-      result.Word[0] = 0xAA;
-      result.Word[1] = 0xFF;
-
-      // throw away next 3 bytes
-      enforce_read(0xFF);
-      enforce_read(0x03);
-      enforce_read(0x00);
 
-      result.Size = 24;
-      for(int i = 0; i < 24;i++)
-      {
-        // temporarily throw away bytes
-        result.Values[i] = read_char();
-      }
-
-      // End of Frame
-      // 55 CC
-      enforce_read(0x55);
-      enforce_read(0xCC);
-      endline();
-  }else
-  {
-    result.Word[0] = byte;
-
-    // log("Received Unexpected byte");
-    // log(byte, HEX);
-
-    result.Malformed = true;
+    port.Delay(1);
   }
 
   endline();
@@ -705,36 +2451,84 @@ radar:
   return result;
 }
 
-// DANGER Assumes array of 8 bytes for speed, no bound checking
-inline static struct TrackedObject GetTrackedObjectFromBytes(unsigned int* bytes);
-inline static struct TrackedObject GetTrackedObjectFromBytes(unsigned int* bytes)
+// Radar frame layout, 3 targets of 8 bytes each, all little endian
+// AA FF 03 00 | X Y Speed Resolution | X Y Speed Resolution | X Y Speed Resolution | 55 CC
+// Example target: 0E 03 B1 86 10 00 40 01 is X -782mm, Y 1713mm, Speed -16cm/s, Resolution 320mm
+#define RADAR_FRAME_HEADER_SIZE 4
+#define TRACKED_OBJECT_SIZE 8
+
+// X, Y and Speed are sign-magnitude int16 where a SET top bit means positive
+// (NOT two's complement), the remaining 15 bits are the absolute value
+// Branchless: the sign bit becomes a 0 or all ones mask, v ^ mask - mask negates when the mask is all ones
+constexpr int16_t DecodeSignMagnitude(uint16_t raw)
 {
-  TrackedObject result;
+  return (int16_t)(((raw & 0x7FFF) ^ ((int)(raw >> 15) - 1)) - ((int)(raw >> 15) - 1));
+}
 
-  result.X = (bytes[0] + bytes[1]) * 256;
-  result.Y = (bytes[2] + bytes[3]) * 256;
-  result.Speed = (bytes[4] + bytes[5]) * 256;
-  result.DistanceResolution = (bytes[6] + bytes[7]) * 256;
+template<typename Byte>
+constexpr uint16_t _DecodeUInt16(const Byte* bytes)
+{
+  return (uint16_t)((bytes[0] & 0xFF) | ((bytes[1] & 0xFF) << 8));
+}
 
-  return result;
+// Decodes one 8 byte target, usable in constexpr context
+// Byte may be the raw uint8_t frame or Command.Values
+template<typename Byte>
+constexpr struct TrackedObject DecodeTrackedObject(const Byte* bytes)
+{
+  return TrackedObject{
+    DecodeSignMagnitude(_DecodeUInt16(bytes + 0)),
+    DecodeSignMagnitude(_DecodeUInt16(bytes + 2)),
+    DecodeSignMagnitude(_DecodeUInt16(bytes + 4)),
+    _DecodeUInt16(bytes + 6),
+    (_DecodeUInt16(bytes + 0) | _DecodeUInt16(bytes + 2) | _DecodeUInt16(bytes + 4) | _DecodeUInt16(bytes + 6)) != 0
+  };
 }
-inline static struct TrackedObjectGroup GetTrackedObjects();
-inline static struct TrackedObjectGroup GetTrackedObjects()
+
+// Decodes all 3 targets of a radar frame in one pass, data points at the 24 data bytes
+// (Command.Values or raw frame + RADAR_FRAME_HEADER_SIZE)
+template<typename Byte>
+constexpr struct TrackedObjectGroup DecodeTrackedObjects(const Byte* data)
 {
-  struct Command response = ReadCommand();
+  return TrackedObjectGroup{
+    DecodeTrackedObject(data + 0 * TRACKED_OBJECT_SIZE),
+    DecodeTrackedObject(data + 1 * TRACKED_OBJECT_SIZE),
+    DecodeTrackedObject(data + 2 * TRACKED_OBJECT_SIZE)
+  };
+}
 
-  TrackedObjectGroup result;
+static_assert(DecodeSignMagnitude(0x030E) == -782, "top bit clear is negative");
+static_assert(DecodeSignMagnitude(0x86B1) == 1713, "top bit set is positive");
+static_assert(DecodeSignMagnitude(0x0000) == 0 && DecodeSignMagnitude(0x8000) == 0, "both zeros are zero");
 
-  result.First = GetTrackedObjectFromBytes(response.Values + 0);
-  result.Second = GetTrackedObjectFromBytes(response.Values + 8);
-  result.Third = GetTrackedObjectFromBytes(response.Values + 16);
+// DANGER Assumes array of 8 bytes for speed, no bound checking
+// Kept for existing callers, same as DecodeTrackedObject
+inline static struct TrackedObject GetTrackedObjectFromBytes(const uint8_t* bytes);
+inline static struct TrackedObject GetTrackedObjectFromBytes(const uint8_t* bytes)
+{
+  return DecodeTrackedObject(bytes);
+}
+template<typename Transport>
+inline static struct TrackedObjectGroup GetTrackedObjects(Transport& port);
+// Returns a group with no Present targets when the next frame is not radar data
+template<typename Transport>
+inline static struct TrackedObjectGroup GetTrackedObjects(Transport& port)
+{
+  struct Command response = ReadCommand(port);
 
-  return result;
+  if(response.Malformed || response.Word[0] != 0xAA)
+  {
+    return TrackedObjectGroup{};
+  }
+
+  return DecodeTrackedObjects(response.Values);
 }
 
 inline static  void LogTrackedObject(struct TrackedObject* object);
 inline static  void LogTrackedObject(struct TrackedObject* object)
 {
+  // log() is empty without LOGGING
+  (void)object;
   log("{ X: ");
   log(object->X, DEC);
   log("mm Y: ");
@@ -743,21 +2537,13 @@ inline static  void LogTrackedObject(struct TrackedObject* object)
   log(object->Speed, DEC);
   log("cm/s Resolution: ");
   log(object->DistanceResolution, DEC);
-  log("cm }");
+  log("mm }");
 }
 
 inline static  bool EmptyGroup(struct TrackedObjectGroup* group);
 inline static  bool EmptyGroup(struct TrackedObjectGroup* group)
 {
-  char* converted = (char*)(void*)group;
-  for(int i = 0; i < sizeof(struct TrackedObjectGroup);i++)
-  {
-    if(converted[i] != 0)
-    {
-      return false;
-    }
-  }
-  return true;
+  return !group->First.Present && !group->Second.Present && !group->Third.Present;
 }
 
 inline static  void LogTrackedObjectGroup(struct TrackedObjectGroup* group);
@@ -776,7 +2562,215 @@ inline static  void LogTrackedObjectGroup(struct TrackedObjectGroup* group)
   log("}");
 }
 
+// One radar: owns its transport and all of its parser / command state, so any number of
+// them can run side by side. It is a transport itself so every function above takes it:
+//   LD2450<ArduinoTransport<HardwareSerial>> left(ArduinoTransport<HardwareSerial>{ &Serial1 });
+//   LD2450<ArduinoTransport<HardwareSerial>> right(ArduinoTransport<HardwareSerial>{ &Serial2 });
+//   InitRadar(left);
+//   InitRadar(right);
+//   struct TrackedObjectGroup group = GetTrackedObjects(left);
+template<typename Transport>
+struct LD2450{
+  Transport Port;
+  struct RadarLink Link;
+
+  LD2450() : Port(), Link() {}
+  explicit LD2450(const Transport& port) : Port(port), Link() {}
+
+  void Begin(unsigned long baud) { Port.Begin(baud); }
+  size_t Available() { return Port.Available(); }
+  size_t Read(uint8_t* buffer, size_t length) { return Port.Read(buffer, length); }
+  size_t Write(const uint8_t* buffer, size_t length) { return Port.Write(buffer, length); }
+  unsigned long Millis() { return Port.Millis(); }
+  unsigned long Micros() { return Port.Micros(); }
+  void Delay(unsigned long ms) { Port.Delay(ms); }
+};
+
+template<typename Transport>
+inline static struct RadarLink* LinkOf(LD2450<Transport>& radar)
+{
+  return &radar.Link;
+}
+
+// Called with the index of the radar in the scheduler and the frame it sent
+typedef void (*RadarFrameCallback)(uint8_t radar, const struct Command* frame, void* context);
+
+// Services several radars from one loop without any of them waiting on the others
+// Radar is LD2450<...> or any transport with its own LinkOf
+template<typename Radar>
+struct RadarScheduler{
+  Radar** Radars;
+  uint8_t Count;
+  // Radar serviced first on the next call, moves along every call so no radar is always last
+  uint8_t Next;
+  RadarFrameCallback OnFrame;
+  void* Context;
+};
+
+// Visits every radar in turn taking at most one complete frame from each per round and skipping
+// radars with nothing waiting, rounds repeat until no radar had a frame or maxFrames were
+// handed out. Never waits, call it from loop() as often as possible.
+// returns the number of frames passed to OnFrame
+template<typename Radar>
+inline static size_t RadarScheduler_Service(struct RadarScheduler<Radar>* scheduler, size_t maxFrames = (size_t)-1)
+{
+  size_t frames = 0;
+  if(scheduler->Count == 0)
+  {
+    return frames;
+  }
+
+  const uint8_t first = scheduler->Next;
+  scheduler->Next = (first + 1) % scheduler->Count;
+
+  bool progress = true;
+  while(progress && frames < maxFrames)
+  {
+    progress = false;
+    for(uint8_t i = 0; i < scheduler->Count && frames < maxFrames; i++)
+    {
+      const uint8_t index = (first + i) % scheduler->Count;
+      Radar& radar = *scheduler->Radars[index];
+      if(radar.Available() == 0 && !LinkOf(radar)->RadarPending)
+      {
+        continue;
+      }
+
+      struct Command frame;
+      if(TryReadCommand(radar, &frame))
+      {
+        scheduler->OnFrame(index, &frame, scheduler->Context);
+        frames++;
+        progress = true;
+      }
+    }
+  }
+
+  return frames;
+}
+
+#if defined(ARDUINO)
+// Wraps any Arduino serial port (HardwareSerial, SoftwareSerial, ...)
+// Arduino streams have no bulk read so Read still goes byte by byte underneath
+template<typename SerialPort>
+struct ArduinoTransport{
+  SerialPort* Port;
+
+  void Begin(unsigned long baud)
+  {
+    Port->begin(baud);
+  }
+
+  size_t Available()
+  {
+    const int available = Port->available();
+    return available > 0 ? available : 0;
+  }
+
+  size_t Read(uint8_t* buffer, size_t length)
+  {
+    size_t i = 0;
+    for(; i < length; ++i)
+    {
+      const int c = Port->read();
+      if(c < 0)
+      {
+        break;
+      }
+      buffer[i] = c;
+    }
+    return i;
+  }
+
+  size_t Write(const uint8_t* buffer, size_t length)
+  {
+    return Port->write(buffer, length);
+  }
+
+  unsigned long Millis()
+  {
+    return millis();
+  }
+
+  unsigned long Micros()
+  {
+    return micros();
+  }
+
+  void Delay(unsigned long ms)
+  {
+    delay(ms);
+  }
+};
+
+// Original Serial1 API, boards without a Serial1 (Uno etc.) can still use ArduinoTransport with another port
+#if !defined(__AVR__) || defined(HAVE_HWSERIAL1)
+static ArduinoTransport<decltype(Serial1)> Serial1Transport = { &Serial1 };
+
+inline static bool InitRadarOnSerial1(struct InitReport* report = NULL, unsigned long timeout_ms = INIT_TIMEOUT_MS)
+{
+  return InitRadar(Serial1Transport, report, timeout_ms);
+}
+
+inline static bool DetectBaudRateOnSerial1(struct InitReport* report)
+{
+  return DetectBaudRate(Serial1Transport, report);
+}
+
+inline static CommandResult UpgradeBaudRateOnSerial1(AvailableBaudRates baud = b460800, struct InitReport* report = NULL)
+{
+  return UpgradeBaudRate(Serial1Transport, baud, report);
+}
+
+inline static void SendCommand(const struct Command* command)
+{
+  SendCommand(Serial1Transport, command);
+}
+
+inline static void WaitForCommand(struct Command* expectedAndOut, bool allowMalformed, size_t timeout_ms, bool timeoutIsSuccess = false, bool resumeRadarIsSuccess = false)
+{
+  WaitForCommand(Serial1Transport, expectedAndOut, allowMalformed, timeout_ms, timeoutIsSuccess, resumeRadarIsSuccess);
+}
+
+inline static struct Command ReadCommand(unsigned int timeout_ms = UINT_MAX)
+{
+  return ReadCommand(Serial1Transport, timeout_ms);
+}
+
+inline static bool TryReadCommand(struct Command* out)
+{
+  return TryReadCommand(Serial1Transport, out);
+}
+
+inline static CommandResult SendCommandAndWaitForACK(const struct Command* command, struct Command* response, bool radarResumeIsSuccess = false)
+{
+  return SendCommandAndWaitForACK(Serial1Transport, command, response, radarResumeIsSuccess);
+}
+
+inline static CommandResult Command_EnableConfigMode() { return Command_EnableConfigMode(Serial1Transport); }
+inline static CommandResult Command_DisableConfigMode() { return Command_DisableConfigMode(Serial1Transport); }
+inline static CommandResult Command_SetSingleTargetTracking() { return Command_SetSingleTargetTracking(Serial1Transport); }
+inline static CommandResult Command_SetMultiTargetTracking() { return Command_SetMultiTargetTracking(Serial1Transport); }
+inline static unsigned int Command_ReadTrackingMode() { return Command_ReadTrackingMode(Serial1Transport); }
+inline static CommandResult Command_SetBaudRate(AvailableBaudRates baud) { return Command_SetBaudRate(Serial1Transport, baud); }
+inline static ZoneConfiguration Command_GetZoneConfiguration() { return Command_GetZoneConfiguration(Serial1Transport); }
+inline static CommandResult Command_SetZoneConfiguration(const ZoneConfiguration* config) { return Command_SetZoneConfiguration(Serial1Transport, config); }
+inline static CommandResult GetZoneFiltering(ZoneConfiguration* out, bool refresh = false) { return GetZoneFiltering(Serial1Transport, out, refresh); }
+inline static CommandResult SetZoneFiltering(const ZoneConfiguration* config) { return SetZoneFiltering(Serial1Transport, config); }
+inline static MacAddress Command_GetMacAddress() { return Command_GetMacAddress(Serial1Transport); }
+inline static CommandResult Command_SetEnableBluetooth(bool enabled) { return Command_SetEnableBluetooth(Serial1Transport, enabled); }
+inline static CommandResult Command_ResetToFactorySettings() { return Command_ResetToFactorySettings(Serial1Transport); }
+inline static CommandResult Command_RestartModule() { return Command_RestartModule(Serial1Transport); }
+
+inline static struct TrackedObjectGroup GetTrackedObjects()
+{
+  return GetTrackedObjects(Serial1Transport);
+}
+#endif
+#endif
+
 // EXAMPLE
+// To send the targets on to a host use HLK_LD2450_Uplink.h rather than printing them as text
 // void loop()
 // {
 //   struct Command command = ReadCommand();
@@ -812,9 +2806,10 @@ inline static  void LogTrackedObjectGroup(struct TrackedObjectGroup* group)
 // }
 
 // remove convenience stuff so we don't pollute other peoples stuff
-#undef write_char(_uint16_tValue)
-#undef read_char()
-#undef endline() 
-#undef log(...)
+#undef log_event
+#undef stats_update
+#undef _event_log_now
+#undef endline
+#undef log
 
 #endif
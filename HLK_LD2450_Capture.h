@@ -0,0 +1,420 @@
+#ifndef HLK_LD2450_Capture_h
+#define HLK_LD2450_Capture_h
+
+#include "HLK_LD2450.h"
+
+// Records exactly what the radar sent, byte for byte with timestamps and a sensor id, so field
+// problems can be replayed through the parser and decoder later
+//
+// File layout, all little endian:
+//   file header  | 8 "LD2450CP" | u16 version | u16 header size | u32 chunk size | u64 start time (unix us) | 8 reserved
+//   chunks       | u32 "LDCK" | u32 records | u32 record bytes | u32 reserved | u64 first timestamp (us) | records...
+//     record     | u32 us since the chunk's first timestamp | u8 sensor | u8 length | length raw bytes
+//   index        | per chunk: u64 file offset | u64 first timestamp | u32 records | u32 reserved
+//   trailer      | u64 index offset | u32 index entries | u32 "LDIX"
+// The index is only there to seek, a file cut short (power loss) or with too many chunks to
+// index is still read front to back through the chunk headers.
+//
+// Recording, the bytes go wherever the sink puts them (file, SD card, socket):
+//   static struct CaptureRecorder recorder;
+//   static struct CaptureTap tap;
+//   CaptureRecorder_Begin(&recorder, WriteToFile, file, 0);
+//   CaptureTap_Attach(&tap, &recorder, 0, LinkOf(port));
+//   ... read the radar as usual ...
+//   CaptureRecorder_End(&recorder);
+//
+// Reading, straight out of memory (see extras/linux/ld2450_replay.cpp for mmap):
+//   struct CaptureReader reader;
+//   struct CaptureRecord record;
+//   if(CaptureReader_Open(&reader, data, size)) while(CaptureReader_Next(&reader, &record)) { ... }
+
+#ifndef CAPTURE_CHUNK_SIZE
+#if defined(__AVR__)
+#define CAPTURE_CHUNK_SIZE 256
+#else
+#define CAPTURE_CHUNK_SIZE 65536
+#endif
+#endif
+
+// Chunks the recorder remembers for the index, files with more are written without one
+#ifndef CAPTURE_MAX_INDEX
+#if defined(__AVR__)
+#define CAPTURE_MAX_INDEX 0
+#else
+#define CAPTURE_MAX_INDEX 4096
+#endif
+#endif
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_HEADER_SIZE 32
+#define CAPTURE_CHUNK_HEADER_SIZE 24
+#define CAPTURE_RECORD_HEADER_SIZE 6
+#define CAPTURE_INDEX_ENTRY_SIZE 24
+#define CAPTURE_TRAILER_SIZE 16
+#define CAPTURE_CHUNK_MAGIC 0x4B43444CUL
+// Longer reads are split over several records
+#define CAPTURE_MAX_RECORD_LENGTH (CAPTURE_CHUNK_SIZE - CAPTURE_CHUNK_HEADER_SIZE - CAPTURE_RECORD_HEADER_SIZE < 255 ? CAPTURE_CHUNK_SIZE - CAPTURE_CHUNK_HEADER_SIZE - CAPTURE_RECORD_HEADER_SIZE : 255)
+#define CAPTURE_INDEX_MAGIC 0x5849444CUL
+
+static const uint8_t CaptureFileMagic[8] = { 'L', 'D', '2', '4', '5', '0', 'C', 'P' };
+
+// Gets every finished piece of the file in order
+typedef void (*CaptureSink)(const uint8_t* bytes, size_t length, void* context);
+
+typedef struct CaptureIndexEntry{
+  uint64_t Offset;
+  uint64_t First_us;
+  uint32_t Records;
+} CaptureIndexEntry;
+
+typedef struct CaptureRecorder{
+  CaptureSink Sink;
+  void* Context;
+  // Bytes handed to Sink so far, the file offset of the next chunk
+  uint64_t Written;
+  uint64_t ChunkFirst_us;
+  uint32_t ChunkRecords;
+  // Chunk header + records so far
+  uint32_t ChunkUsed;
+  uint32_t IndexCount;
+  bool IndexOverflow;
+  struct CaptureIndexEntry Index[CAPTURE_MAX_INDEX > 0 ? CAPTURE_MAX_INDEX : 1];
+  uint8_t Chunk[CAPTURE_CHUNK_SIZE];
+} CaptureRecorder;
+
+// Binds one radar's receive path to a recorder
+typedef struct CaptureTap{
+  struct CaptureRecorder* Recorder;
+  uint8_t Sensor;
+  // port.Micros() is 32 bits on Arduino, it is widened here so long captures keep counting
+  unsigned long LastMicros;
+  uint64_t Clock_us;
+  bool Started;
+} CaptureTap;
+
+typedef struct CaptureRecord{
+  uint64_t Timestamp_us;
+  uint8_t Sensor;
+  uint8_t Length;
+  // Points into the capture, valid as long as it is
+  const uint8_t* Bytes;
+} CaptureRecord;
+
+typedef struct CaptureReader{
+  const uint8_t* Data;
+  size_t Size;
+  uint64_t Start_unix_us;
+  // Index from the trailer, NULL when the file has none
+  const uint8_t* Index;
+  uint32_t IndexCount;
+  // Current chunk and position inside it
+  size_t Chunk;
+  size_t ChunkEnd;
+  size_t Position;
+  uint64_t ChunkFirst_us;
+} CaptureReader;
+
+inline static void CaptureRecorder_Begin(struct CaptureRecorder* recorder, CaptureSink sink, void* context, uint64_t start_unix_us);
+inline static void CaptureRecorder_Record(struct CaptureRecorder* recorder, uint8_t sensor, uint64_t timestamp_us, const uint8_t* bytes, size_t length);
+inline static void CaptureRecorder_Flush(struct CaptureRecorder* recorder);
+inline static void CaptureRecorder_End(struct CaptureRecorder* recorder);
+inline static void CaptureTap_Attach(struct CaptureTap* tap, struct CaptureRecorder* recorder, uint8_t sensor, struct RadarLink* link);
+inline static void CaptureTap_Detach(struct RadarLink* link);
+inline static bool CaptureReader_Open(struct CaptureReader* reader, const uint8_t* data, size_t size);
+inline static bool CaptureReader_Next(struct CaptureReader* reader, struct CaptureRecord* out);
+inline static void CaptureReader_Seek(struct CaptureReader* reader, uint64_t timestamp_us);
+
+inline static uint8_t* _Capture_Put32(uint8_t* bytes, uint32_t value)
+{
+  *bytes++ = value;
+  *bytes++ = value >> 8;
+  *bytes++ = value >> 16;
+  *bytes++ = value >> 24;
+  return bytes;
+}
+
+inline static uint8_t* _Capture_Put64(uint8_t* bytes, uint64_t value)
+{
+  bytes = _Capture_Put32(bytes, (uint32_t)value);
+  return _Capture_Put32(bytes, (uint32_t)(value >> 32));
+}
+
+inline static uint32_t _Capture_Get32(const uint8_t* bytes)
+{
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+inline static uint64_t _Capture_Get64(const uint8_t* bytes)
+{
+  return (uint64_t)_Capture_Get32(bytes) | ((uint64_t)_Capture_Get32(bytes + 4) << 32);
+}
+
+// Writes the file header, start_unix_us is only for people reading the file (0 if unknown)
+inline static void CaptureRecorder_Begin(struct CaptureRecorder* recorder, CaptureSink sink, void* context, uint64_t start_unix_us)
+{
+  recorder->Sink = sink;
+  recorder->Context = context;
+  recorder->Written = 0;
+  recorder->ChunkRecords = 0;
+  recorder->ChunkUsed = CAPTURE_CHUNK_HEADER_SIZE;
+  recorder->IndexCount = 0;
+  recorder->IndexOverflow = false;
+
+  uint8_t header[CAPTURE_FILE_HEADER_SIZE] = {};
+  memcpy(header, CaptureFileMagic, sizeof(CaptureFileMagic));
+  header[8] = CAPTURE_VERSION;
+  header[10] = CAPTURE_FILE_HEADER_SIZE;
+  _Capture_Put32(header + 12, CAPTURE_CHUNK_SIZE);
+  _Capture_Put64(header + 16, start_unix_us);
+
+  sink(header, sizeof(header), context);
+  recorder->Written = sizeof(header);
+}
+
+// Appends one read, chunks go to the sink as they fill up
+inline static void CaptureRecorder_Record(struct CaptureRecorder* recorder, uint8_t sensor, uint64_t timestamp_us, const uint8_t* bytes, size_t length)
+{
+  // reads are at most MAX_FRAME_SIZE but a caller might pass more, split it
+  while(length > CAPTURE_MAX_RECORD_LENGTH)
+  {
+    CaptureRecorder_Record(recorder, sensor, timestamp_us, bytes, CAPTURE_MAX_RECORD_LENGTH);
+    bytes += CAPTURE_MAX_RECORD_LENGTH;
+    length -= CAPTURE_MAX_RECORD_LENGTH;
+  }
+
+  if(recorder->ChunkRecords > 0 &&
+     (recorder->ChunkUsed + CAPTURE_RECORD_HEADER_SIZE + length > CAPTURE_CHUNK_SIZE ||
+      timestamp_us < recorder->ChunkFirst_us || timestamp_us - recorder->ChunkFirst_us > 0xFFFFFFFFULL))
+  {
+    CaptureRecorder_Flush(recorder);
+  }
+
+  if(recorder->ChunkRecords == 0)
+  {
+    recorder->ChunkFirst_us = timestamp_us;
+  }
+
+  uint8_t* record = recorder->Chunk + recorder->ChunkUsed;
+  record = _Capture_Put32(record, (uint32_t)(timestamp_us - recorder->ChunkFirst_us));
+  *record++ = sensor;
+  *record++ = length;
+  memcpy(record, bytes, length);
+
+  recorder->ChunkUsed += CAPTURE_RECORD_HEADER_SIZE + length;
+  recorder->ChunkRecords++;
+}
+
+// Hands the current chunk to the sink, also done on its own when a chunk fills up
+inline static void CaptureRecorder_Flush(struct CaptureRecorder* recorder)
+{
+  if(recorder->ChunkRecords == 0)
+  {
+    return;
+  }
+
+  uint8_t* header = recorder->Chunk;
+  header = _Capture_Put32(header, CAPTURE_CHUNK_MAGIC);
+  header = _Capture_Put32(header, recorder->ChunkRecords);
+  header = _Capture_Put32(header, recorder->ChunkUsed - CAPTURE_CHUNK_HEADER_SIZE);
+  header = _Capture_Put32(header, 0);
+  _Capture_Put64(header, recorder->ChunkFirst_us);
+
+  if(recorder->IndexCount < CAPTURE_MAX_INDEX)
+  {
+    struct CaptureIndexEntry* entry = &recorder->Index[recorder->IndexCount++];
+    entry->Offset = recorder->Written;
+    entry->First_us = recorder->ChunkFirst_us;
+    entry->Records = recorder->ChunkRecords;
+  }
+  else
+  {
+    recorder->IndexOverflow = true;
+  }
+
+  recorder->Sink(recorder->Chunk, recorder->ChunkUsed, recorder->Context);
+  recorder->Written += recorder->ChunkUsed;
+  recorder->ChunkRecords = 0;
+  recorder->ChunkUsed = CAPTURE_CHUNK_HEADER_SIZE;
+}
+
+// Flushes the last chunk and writes the index and trailer
+inline static void CaptureRecorder_End(struct CaptureRecorder* recorder)
+{
+  CaptureRecorder_Flush(recorder);
+
+  const uint64_t indexOffset = recorder->Written;
+  const uint32_t count = recorder->IndexOverflow ? 0 : recorder->IndexCount;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    uint8_t entry[CAPTURE_INDEX_ENTRY_SIZE] = {};
+    _Capture_Put64(entry, recorder->Index[i].Offset);
+    _Capture_Put64(entry + 8, recorder->Index[i].First_us);
+    _Capture_Put32(entry + 16, recorder->Index[i].Records);
+    recorder->Sink(entry, sizeof(entry), recorder->Context);
+    recorder->Written += sizeof(entry);
+  }
+
+  uint8_t trailer[CAPTURE_TRAILER_SIZE];
+  _Capture_Put64(trailer, indexOffset);
+  _Capture_Put32(trailer + 8, count);
+  _Capture_Put32(trailer + 12, CAPTURE_INDEX_MAGIC);
+  recorder->Sink(trailer, sizeof(trailer), recorder->Context);
+  recorder->Written += sizeof(trailer);
+}
+
+inline static void _CaptureTap_OnReceive(const uint8_t* bytes, size_t length, unsigned long micros, void* context)
+{
+  struct CaptureTap* tap = (struct CaptureTap*)context;
+  if(tap->Started)
+  {
+    tap->Clock_us += (unsigned long)(micros - tap->LastMicros);
+  }
+  else
+  {
+    tap->Clock_us = micros;
+    tap->Started = true;
+  }
+  tap->LastMicros = micros;
+
+  CaptureRecorder_Record(tap->Recorder, tap->Sensor, tap->Clock_us, bytes, length);
+}
+
+// Records every byte read through link (LinkOf(port)) from now on as sensor
+// several taps can share a recorder as long as they are read from the same thread
+inline static void CaptureTap_Attach(struct CaptureTap* tap, struct CaptureRecorder* recorder, uint8_t sensor, struct RadarLink* link)
+{
+  tap->Recorder = recorder;
+  tap->Sensor = sensor;
+  tap->LastMicros = 0;
+  tap->Clock_us = 0;
+  tap->Started = false;
+
+  link->OnReceive = _CaptureTap_OnReceive;
+  link->ReceiveContext = tap;
+}
+
+inline static void CaptureTap_Detach(struct RadarLink* link)
+{
+  link->OnReceive = NULL;
+  link->ReceiveContext = NULL;
+}
+
+inline static bool _CaptureReader_EnterChunk(struct CaptureReader* reader, size_t offset)
+{
+  if(offset + CAPTURE_CHUNK_HEADER_SIZE > reader->Size || _Capture_Get32(reader->Data + offset) != CAPTURE_CHUNK_MAGIC)
+  {
+    return false;
+  }
+
+  const size_t length = _Capture_Get32(reader->Data + offset + 8);
+  if(offset + CAPTURE_CHUNK_HEADER_SIZE + length > reader->Size)
+  {
+    // cut short, read what made it
+    reader->ChunkEnd = reader->Size;
+  }
+  else
+  {
+    reader->ChunkEnd = offset + CAPTURE_CHUNK_HEADER_SIZE + length;
+  }
+
+  reader->Chunk = offset;
+  reader->Position = offset + CAPTURE_CHUNK_HEADER_SIZE;
+  reader->ChunkFirst_us = _Capture_Get64(reader->Data + offset + 16);
+  return true;
+}
+
+// Checks the header and finds the index, returns false if data isn't a capture
+inline static bool CaptureReader_Open(struct CaptureReader* reader, const uint8_t* data, size_t size)
+{
+  memset(reader, 0, sizeof(struct CaptureReader));
+  if(size < CAPTURE_FILE_HEADER_SIZE || memcmp(data, CaptureFileMagic, sizeof(CaptureFileMagic)) != 0 || data[8] != CAPTURE_VERSION)
+  {
+    return false;
+  }
+
+  reader->Data = data;
+  reader->Size = size;
+  reader->Start_unix_us = _Capture_Get64(data + 16);
+
+  if(size >= CAPTURE_FILE_HEADER_SIZE + CAPTURE_TRAILER_SIZE)
+  {
+    const uint8_t* trailer = data + size - CAPTURE_TRAILER_SIZE;
+    const uint64_t offset = _Capture_Get64(trailer);
+    const uint32_t count = _Capture_Get32(trailer + 8);
+    if(_Capture_Get32(trailer + 12) == CAPTURE_INDEX_MAGIC && offset + (uint64_t)count * CAPTURE_INDEX_ENTRY_SIZE + CAPTURE_TRAILER_SIZE == size)
+    {
+      reader->Index = count > 0 ? data + offset : NULL;
+      reader->IndexCount = count;
+      // the chunks stop where the index starts
+      reader->Size = offset;
+    }
+  }
+
+  if(!_CaptureReader_EnterChunk(reader, CAPTURE_FILE_HEADER_SIZE))
+  {
+    // empty capture
+    reader->Position = reader->ChunkEnd = reader->Size;
+  }
+  return true;
+}
+
+// Next record in file order, false at the end
+inline static bool CaptureReader_Next(struct CaptureReader* reader, struct CaptureRecord* out)
+{
+  while(reader->Position + CAPTURE_RECORD_HEADER_SIZE > reader->ChunkEnd)
+  {
+    if(reader->ChunkEnd >= reader->Size || !_CaptureReader_EnterChunk(reader, reader->ChunkEnd))
+    {
+      return false;
+    }
+  }
+
+  const uint8_t* record = reader->Data + reader->Position;
+  const uint8_t length = record[5];
+  if(reader->Position + CAPTURE_RECORD_HEADER_SIZE + length > reader->ChunkEnd)
+  {
+    // torn record at the end of a cut short file
+    reader->Position = reader->ChunkEnd = reader->Size;
+    return false;
+  }
+
+  out->Timestamp_us = reader->ChunkFirst_us + _Capture_Get32(record);
+  out->Sensor = record[4];
+  out->Length = length;
+  out->Bytes = record + CAPTURE_RECORD_HEADER_SIZE;
+
+  reader->Position += CAPTURE_RECORD_HEADER_SIZE + length;
+  return true;
+}
+
+// Moves to the start of the last chunk beginning at or before timestamp_us (binary search on the
+// index), or back to the start if there is no index
+inline static void CaptureReader_Seek(struct CaptureReader* reader, uint64_t timestamp_us)
+{
+  size_t offset = CAPTURE_FILE_HEADER_SIZE;
+  if(reader->Index != NULL)
+  {
+    uint32_t low = 0;
+    uint32_t high = reader->IndexCount;
+    while(high - low > 1)
+    {
+      const uint32_t middle = low + (high - low) / 2;
+      if(_Capture_Get64(reader->Index + (size_t)middle * CAPTURE_INDEX_ENTRY_SIZE + 8) <= timestamp_us)
+      {
+        low = middle;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    offset = _Capture_Get64(reader->Index + (size_t)low * CAPTURE_INDEX_ENTRY_SIZE);
+  }
+
+  if(!_CaptureReader_EnterChunk(reader, offset))
+  {
+    reader->Position = reader->ChunkEnd = reader->Size;
+  }
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef HLK_LD2450_Changes_h
+#define HLK_LD2450_Changes_h
+
+#include "HLK_LD2450.h"
+
+// Turns the radar's stream of frames into the few moments something actually changed
+// Each of the 3 target slots is compared with what was last reported for it, a callback fires
+// when a target enters, leaves, or has moved or changed speed by more than a threshold since
+// the last report. A target has to be missing for a few frames before it counts as gone so a
+// single dropped detection doesn't produce an exit and an enter. Everything lives in the struct.
+//
+//   static struct TargetChanges changes;
+//   void OnChange(const struct TargetChange* change, void* context) { ... }
+//   TargetChanges_Init(&changes, NULL, OnChange, NULL);
+//
+//   struct TrackedObjectGroup group = GetTrackedObjects();
+//   TargetChanges_Update(&changes, &group, millis());
+//
+// Slots are compared as the radar numbers them, and the radar may swap targets between slots,
+// HLK_LD2450_Tracker.h gives targets ids that survive that.
+
+typedef enum TargetChangeType{
+  TargetChange_None = 0x0,
+  TargetChange_Enter = 0x1,
+  // Fired once the target has been missing for ExitFrames frames, X Y and Speed are where it was
+  // last seen, which may be closer than the threshold to the last Enter or Move
+  TargetChange_Exit = 0x2,
+  TargetChange_Move = 0x3
+} TargetChangeType;
+
+typedef struct TargetChange{
+  uint8_t Type;
+  // 0 First, 1 Second, 2 Third
+  uint8_t Slot;
+  int16_t X;
+  int16_t Y;
+  int16_t Speed;
+  // Time since the target entered, 0 for TargetChange_Enter
+  unsigned long Dwell_ms;
+} TargetChange;
+
+typedef void (*TargetChangeCallback)(const struct TargetChange* change, void* context);
+
+typedef struct TargetChangeSettings{
+  // A move is reported once the target is further than this from where it was last reported
+  // at most TARGET_CHANGE_MAX_DISTANCE_MM
+  uint16_t Distance_mm;
+  // or its speed differs by more than this from the last reported speed
+  uint16_t Speed_cms;
+  // Consecutive frames without the target before it has left, at least 1
+  uint8_t ExitFrames;
+} TargetChangeSettings;
+
+#ifndef TARGET_CHANGE_DISTANCE_MM
+#define TARGET_CHANGE_DISTANCE_MM 150
+#endif
+
+#ifndef TARGET_CHANGE_SPEED_CMS
+#define TARGET_CHANGE_SPEED_CMS 20
+#endif
+
+// The radar reports at about 10Hz
+#ifndef TARGET_CHANGE_EXIT_FRAMES
+#define TARGET_CHANGE_EXIT_FRAMES 5
+#endif
+
+// Keeps the squared distances in 32 bits, far beyond the radar's range anyway
+#define TARGET_CHANGE_MAX_DISTANCE_MM 40000
+
+static const struct TargetChangeSettings DefaultTargetChangeSettings = { TARGET_CHANGE_DISTANCE_MM, TARGET_CHANGE_SPEED_CMS, TARGET_CHANGE_EXIT_FRAMES };
+
+typedef struct TargetSlotState{
+  bool Present;
+  // Frames in a row the target has been missing while still counted as present
+  uint8_t Missing;
+  // As last reported
+  int16_t X;
+  int16_t Y;
+  int16_t Speed;
+  // As last seen, for the exit
+  int16_t SeenX;
+  int16_t SeenY;
+  int16_t SeenSpeed;
+  unsigned long Entered_ms;
+} TargetSlotState;
+
+typedef struct TargetChanges{
+  struct TargetChangeSettings Settings;
+  struct TargetSlotState Slots[3];
+  TargetChangeCallback OnChange;
+  void* Context;
+} TargetChanges;
+
+inline static void TargetChanges_Init(struct TargetChanges* changes, const struct TargetChangeSettings* settings, TargetChangeCallback onChange, void* context);
+inline static uint8_t TargetChanges_Update(struct TargetChanges* changes, const struct TrackedObjectGroup* group, unsigned long now_ms);
+inline static unsigned long TargetChanges_Dwell(const struct TargetChanges* changes, uint8_t slot, unsigned long now_ms);
+
+// settings may be NULL for DefaultTargetChangeSettings
+inline static void TargetChanges_Init(struct TargetChanges* changes, const struct TargetChangeSettings* settings, TargetChangeCallback onChange, void* context)
+{
+  memset(changes, 0, sizeof(struct TargetChanges));
+  changes->Settings = settings != NULL ? *settings : DefaultTargetChangeSettings;
+  if(changes->Settings.ExitFrames == 0)
+  {
+    changes->Settings.ExitFrames = 1;
+  }
+  if(changes->Settings.Distance_mm > TARGET_CHANGE_MAX_DISTANCE_MM)
+  {
+    changes->Settings.Distance_mm = TARGET_CHANGE_MAX_DISTANCE_MM;
+  }
+  changes->OnChange = onChange;
+  changes->Context = context;
+}
+
+inline static void _TargetChanges_Fire(struct TargetChanges* changes, uint8_t type, uint8_t slot, unsigned long now_ms)
+{
+  const struct TargetSlotState* state = &changes->Slots[slot];
+  if(changes->OnChange == NULL)
+  {
+    return;
+  }
+
+  const bool exit = type == TargetChange_Exit;
+  struct TargetChange change;
+  change.Type = type;
+  change.Slot = slot;
+  change.X = exit ? state->SeenX : state->X;
+  change.Y = exit ? state->SeenY : state->Y;
+  change.Speed = exit ? state->SeenSpeed : state->Speed;
+  change.Dwell_ms = type == TargetChange_Enter ? 0 : now_ms - state->Entered_ms;
+  changes->OnChange(&change, changes->Context);
+}
+
+inline static bool _TargetChanges_Moved(const struct TargetChanges* changes, const struct TargetSlotState* state, const struct TrackedObject* object)
+{
+  const int32_t dx = (int32_t)object->X - state->X;
+  const int32_t dy = (int32_t)object->Y - state->Y;
+  const uint32_t x = dx < 0 ? -dx : dx;
+  const uint32_t y = dy < 0 ? -dy : dy;
+  const uint32_t distance = changes->Settings.Distance_mm;
+  // squared so there is no square root, past the distance on one axis is moved for sure
+  // and keeps the squares in range
+  if(x > distance || y > distance || x * x + y * y > distance * distance)
+  {
+    return true;
+  }
+
+  const int32_t speed = (int32_t)object->Speed - state->Speed;
+  return speed > changes->Settings.Speed_cms || -speed > changes->Settings.Speed_cms;
+}
+
+// Compares a decoded frame with the last reported state and fires the callback for every change
+// returns how many changes there were
+inline static uint8_t TargetChanges_Update(struct TargetChanges* changes, const struct TrackedObjectGroup* group, unsigned long now_ms)
+{
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+  uint8_t fired = 0;
+
+  for(uint8_t slot = 0; slot < 3; slot++)
+  {
+    const struct TrackedObject* object = objects[slot];
+    struct TargetSlotState* state = &changes->Slots[slot];
+
+    if(!object->Present)
+    {
+      if(state->Present && ++state->Missing >= changes->Settings.ExitFrames)
+      {
+        _TargetChanges_Fire(changes, TargetChange_Exit, slot, now_ms);
+        state->Present = false;
+        state->Missing = 0;
+        fired++;
+      }
+      continue;
+    }
+
+    state->Missing = 0;
+    state->SeenX = object->X;
+    state->SeenY = object->Y;
+    state->SeenSpeed = object->Speed;
+    uint8_t type = TargetChange_None;
+    if(!state->Present)
+    {
+      state->Present = true;
+      state->Entered_ms = now_ms;
+      type = TargetChange_Enter;
+    }
+    else if(_TargetChanges_Moved(changes, state, object))
+    {
+      type = TargetChange_Move;
+    }
+    else
+    {
+      continue;
+    }
+
+    state->X = object->X;
+    state->Y = object->Y;
+    state->Speed = object->Speed;
+    _TargetChanges_Fire(changes, type, slot, now_ms);
+    fired++;
+  }
+
+  return fired;
+}
+
+// How long the target in slot has been there, 0 when there is none
+inline static unsigned long TargetChanges_Dwell(const struct TargetChanges* changes, uint8_t slot, unsigned long now_ms)
+{
+  const struct TargetSlotState* state = &changes->Slots[slot];
+  return state->Present ? now_ms - state->Entered_ms : 0;
+}
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef HLK_LD2450_Fusion_h
+#define HLK_LD2450_Fusion_h
+
+#include <math.h>
+
+#include "HLK_LD2450.h"
+
+// Merges several radars looking at the same space into one list of targets in room coordinates
+// Every sensor has a pose, where it is in the room and which way it faces, turned into a fixed
+// point rotation once when it is set. Decoded frames are moved into room coordinates as they
+// arrive and kept per sensor, sorted along X, with their receive time. Fusion_Step takes the latest
+// frame of each sensor that is recent enough, merges them pairwise into one list sorted along X and
+// sweeps it, so detections from different sensors closer than MergeDistance_mm become one target.
+// For N detections from S sensors the merge is N log2(S), the sweep compares each detection only
+// with the ones less than MergeDistance_mm further along X.
+//
+//   static struct Fusion fusion;
+//   Fusion_Init(&fusion, 300, 150);
+//   Fusion_SetPose(&fusion, 0, 0, 0, 0);          // sensor 0 in the corner, facing +Y
+//   Fusion_SetPose(&fusion, 1, 4000, 0, 900);     // sensor 1 4m along X, turned 90 degrees
+//
+//   Fusion_Add(&fusion, sensor, &group, millis());  // for every frame of every sensor
+//   struct FusedTarget targets[FUSION_MAX_TARGETS];
+//   uint8_t count = Fusion_Step(&fusion, millis(), targets);
+
+#ifndef FUSION_MAX_SENSORS
+#if defined(__AVR__)
+#define FUSION_MAX_SENSORS 4
+#else
+#define FUSION_MAX_SENSORS 16
+#endif
+#endif
+
+#if FUSION_MAX_SENSORS > 16
+#error FUSION_MAX_SENSORS can not be more than 16
+#endif
+
+#define FUSION_MAX_TARGETS (FUSION_MAX_SENSORS * 3)
+
+// Keeps the squared distances in 32 bits
+#define FUSION_MAX_MERGE_DISTANCE_MM 40000
+
+// Rotation entries carry this many fraction bits
+#define FUSION_FRACTION_BITS 14
+
+// Where a sensor is and which way it faces, room = rotation * module + translation
+// Module coordinates are the ones drawn at ZoneVertex, seen from above they are right handed
+// like the room so a rotation is all it takes
+typedef struct SensorPose{
+  // cos and sin of the heading, FUSION_FRACTION_BITS fraction bits
+  int16_t Cos;
+  int16_t Sin;
+  // Position of the sensor in room millimeters
+  int32_t X;
+  int32_t Y;
+  bool Set;
+} SensorPose;
+
+typedef struct FusionPoint{
+  int32_t X;
+  int32_t Y;
+  int16_t Speed;
+  uint8_t Sensor;
+} FusionPoint;
+
+typedef struct FusionSensorFrame{
+  struct FusionPoint Points[3];
+  uint8_t Count;
+  unsigned long Received_ms;
+  bool Valid;
+} FusionSensorFrame;
+
+typedef struct FusedTarget{
+  // Room millimeters, the mean of the merged detections
+  int32_t X;
+  int32_t Y;
+  // Mean of the radial speeds, each is relative to its own sensor so it is only a hint
+  int16_t Speed;
+  // Bit i set when sensor i saw it
+  uint16_t Sensors;
+} FusedTarget;
+
+typedef struct Fusion{
+  struct SensorPose Poses[FUSION_MAX_SENSORS];
+  struct FusionSensorFrame Frames[FUSION_MAX_SENSORS];
+  uint16_t MergeDistance_mm;
+  // Frames older than this at Fusion_Step are left out
+  uint16_t MaxAge_ms;
+} Fusion;
+
+inline static void Fusion_Init(struct Fusion* fusion, uint16_t mergeDistance_mm, uint16_t maxAge_ms);
+inline static bool Fusion_SetPose(struct Fusion* fusion, uint8_t sensor, int32_t x_mm, int32_t y_mm, int16_t heading_decidegrees);
+inline static void Fusion_ToRoom(const struct SensorPose* pose, int32_t x, int32_t y, int32_t* roomX, int32_t* roomY);
+inline static bool Fusion_Add(struct Fusion* fusion, uint8_t sensor, const struct TrackedObjectGroup* group, unsigned long received_ms);
+inline static uint8_t Fusion_Step(struct Fusion* fusion, unsigned long now_ms, struct FusedTarget* out);
+
+inline static void Fusion_Init(struct Fusion* fusion, uint16_t mergeDistance_mm, uint16_t maxAge_ms)
+{
+  memset(fusion, 0, sizeof(struct Fusion));
+  fusion->MergeDistance_mm = mergeDistance_mm > FUSION_MAX_MERGE_DISTANCE_MM ? FUSION_MAX_MERGE_DISTANCE_MM : mergeDistance_mm;
+  fusion->MaxAge_ms = maxAge_ms;
+}
+
+// heading is counter clockwise from room +Y in tenths of a degree, returns false for an unknown sensor
+// The only floating point is here, once per sensor
+inline static bool Fusion_SetPose(struct Fusion* fusion, uint8_t sensor, int32_t x_mm, int32_t y_mm, int16_t heading_decidegrees)
+{
+  if(sensor >= FUSION_MAX_SENSORS)
+  {
+    return false;
+  }
+
+  const double radians = heading_decidegrees * (M_PI / 1800.0);
+  struct SensorPose* pose = &fusion->Poses[sensor];
+  pose->Cos = (int16_t)lround(cos(radians) * (1 << FUSION_FRACTION_BITS));
+  pose->Sin = (int16_t)lround(sin(radians) * (1 << FUSION_FRACTION_BITS));
+  pose->X = x_mm;
+  pose->Y = y_mm;
+  pose->Set = true;
+  return true;
+}
+
+// Module millimeters to room millimeters
+inline static void Fusion_ToRoom(const struct SensorPose* pose, int32_t x, int32_t y, int32_t* roomX, int32_t* roomY)
+{
+  // |x|, |y| < 2^15 and |Cos|, |Sin| <= 2^14 so each sum stays below 2^30
+  *roomX = ((pose->Cos * x - pose->Sin * y) >> FUSION_FRACTION_BITS) + pose->X;
+  *roomY = ((pose->Sin * x + pose->Cos * y) >> FUSION_FRACTION_BITS) + pose->Y;
+}
+
+// Moves a decoded frame into room coordinates and keeps it as the sensor's latest
+// returns false when the sensor has no pose
+inline static bool Fusion_Add(struct Fusion* fusion, uint8_t sensor, const struct TrackedObjectGroup* group, unsigned long received_ms)
+{
+  if(sensor >= FUSION_MAX_SENSORS || !fusion->Poses[sensor].Set)
+  {
+    return false;
+  }
+
+  const struct SensorPose* pose = &fusion->Poses[sensor];
+  struct FusionSensorFrame* frame = &fusion->Frames[sensor];
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+
+  frame->Count = 0;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    if(!objects[i]->Present)
+    {
+      continue;
+    }
+
+    struct FusionPoint point;
+    Fusion_ToRoom(pose, objects[i]->X, objects[i]->Y, &point.X, &point.Y);
+    point.Speed = objects[i]->Speed;
+    point.Sensor = sensor;
+
+    // kept sorted by X so Fusion_Step only has to merge the sensors' lists
+    uint8_t at = frame->Count++;
+    while(at > 0 && frame->Points[at - 1].X > point.X)
+    {
+      frame->Points[at] = frame->Points[at - 1];
+      at--;
+    }
+    frame->Points[at] = point;
+  }
+
+  frame->Received_ms = received_ms;
+  frame->Valid = true;
+  return true;
+}
+
+// One deduplicated target list from the latest frame of every sensor received within MaxAge_ms
+// of now_ms, out needs room for FUSION_MAX_TARGETS, returns how many targets were written
+// A frame received after now_ms counts as too old, call it with the time of the newest frame or later
+inline static uint8_t Fusion_Step(struct Fusion* fusion, unsigned long now_ms, struct FusedTarget* out)
+{
+  // pointers into the frames, cheaper to move around than the points
+  const struct FusionPoint* buffers[2][FUSION_MAX_TARGETS];
+  // where each sorted run starts, runs[runCount] is where the last one ends
+  uint8_t runs[FUSION_MAX_SENSORS + 1];
+  uint8_t runCount = 0;
+  uint8_t count = 0;
+
+  for(uint8_t sensor = 0; sensor < FUSION_MAX_SENSORS; sensor++)
+  {
+    const struct FusionSensorFrame* frame = &fusion->Frames[sensor];
+    if(!frame->Valid || frame->Count == 0 || now_ms - frame->Received_ms > fusion->MaxAge_ms)
+    {
+      continue;
+    }
+
+    runs[runCount++] = count;
+    for(uint8_t i = 0; i < frame->Count; i++)
+    {
+      buffers[0][count++] = &frame->Points[i];
+    }
+  }
+  runs[runCount] = count;
+
+  // every pass merges neighbouring runs, halving how many there are
+  uint8_t from = 0;
+  while(runCount > 1)
+  {
+    const struct FusionPoint* const* source = buffers[from];
+    const struct FusionPoint** target = buffers[from ^ 1];
+    uint8_t pairs = 0;
+
+    for(uint8_t run = 0; run < runCount; run += 2)
+    {
+      const uint8_t begin = runs[run];
+      const uint8_t middle = runs[run + 1];
+      const uint8_t end = run + 2 <= runCount ? runs[run + 2] : middle;
+      uint8_t left = begin;
+      uint8_t right = middle;
+      for(uint8_t at = begin; at < end; at++)
+      {
+        target[at] = right >= end || (left < middle && source[left]->X <= source[right]->X) ? source[left++] : source[right++];
+      }
+      // only runs already read are overwritten
+      runs[pairs++] = begin;
+    }
+
+    runs[pairs] = count;
+    runCount = pairs;
+    from ^= 1;
+  }
+  const struct FusionPoint* const* points = buffers[from];
+
+  // sweep along X, only points within MergeDistance_mm in X can be close enough to merge
+  const int32_t distance = fusion->MergeDistance_mm;
+  const uint32_t distanceSquared = (uint32_t)distance * (uint32_t)distance;
+  bool merged[FUSION_MAX_TARGETS] = {};
+  uint8_t targets = 0;
+
+  for(uint8_t i = 0; i < count; i++)
+  {
+    if(merged[i])
+    {
+      continue;
+    }
+
+    int32_t sumX = points[i]->X;
+    int32_t sumY = points[i]->Y;
+    int32_t sumSpeed = points[i]->Speed;
+    uint16_t sensors = 1U << points[i]->Sensor;
+    uint8_t members = 1;
+
+    for(uint8_t j = i + 1; j < count && points[j]->X - points[i]->X <= distance; j++)
+    {
+      // a sensor reports one person once, two detections from it are two people
+      if(merged[j] || (sensors & (1U << points[j]->Sensor)) != 0)
+      {
+        continue;
+      }
+
+      // sorted so dx is never negative, past the distance in Y can't merge and keeps the squares in range
+      const uint32_t dx = points[j]->X - points[i]->X;
+      const int32_t dy = points[j]->Y - points[i]->Y;
+      if(dy > distance || -dy > distance || dx * dx + (uint32_t)(dy * dy) > distanceSquared)
+      {
+        continue;
+      }
+
+      merged[j] = true;
+      sumX += points[j]->X;
+      sumY += points[j]->Y;
+      sumSpeed += points[j]->Speed;
+      sensors |= 1U << points[j]->Sensor;
+      members++;
+    }
+
+    struct FusedTarget* target = &out[targets++];
+    target->X = sumX / members;
+    target->Y = sumY / members;
+    target->Speed = sumSpeed / members;
+    target->Sensors = sensors;
+  }
+
+  return targets;
+}
+
+#endif
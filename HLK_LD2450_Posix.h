@@ -0,0 +1,209 @@
+#ifndef HLK_LD2450_Posix_h
+#define HLK_LD2450_Posix_h
+
+// Linux transport for the driver, talks to the radar through a tty (/dev/ttyUSB0 etc.) or a pty
+//
+//   PosixTransport port;
+//   if(port.Open("/dev/ttyUSB0", 256000))
+//   {
+//     InitRadar(port);
+//     struct TrackedObjectGroup group = GetTrackedObjects(port);
+//   }
+
+#if !defined(__linux__)
+#error HLK_LD2450_Posix.h uses termios2 and only supports Linux
+#endif
+
+// termios2 lets us ask for 256000 which is not one of the standard B* rates
+// it can not be included together with <termios.h>
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+
+#include "HLK_LD2450.h"
+
+// Bytes pulled in by a single read() call
+#ifndef POSIX_TRANSPORT_BUFFER_SIZE
+#define POSIX_TRANSPORT_BUFFER_SIZE 256
+#endif
+
+struct PosixTransport{
+  int Fd = -1;
+  // Each transport carries its own link so several radars can be open at once
+  struct RadarLink Link = {};
+  // Bytes read from Fd that have not been handed out yet, Buffer[Start..End)
+  uint8_t Buffer[POSIX_TRANSPORT_BUFFER_SIZE];
+  size_t Start = 0;
+  size_t End = 0;
+
+  // Opens the device raw 8N1 at the given baud rate, returns false on failure (see errno)
+  bool Open(const char* path, unsigned long baud)
+  {
+    Close();
+
+    Fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(Fd < 0)
+    {
+      return false;
+    }
+
+    if(!Configure(baud))
+    {
+      Close();
+      return false;
+    }
+
+    return true;
+  }
+
+  void Close()
+  {
+    if(Fd >= 0)
+    {
+      close(Fd);
+    }
+    Fd = -1;
+    Start = End = 0;
+  }
+
+  // Raw 8N1 at any baud rate, throws away whatever was received at the old rate
+  bool Configure(unsigned long baud)
+  {
+    struct termios2 options;
+    if(ioctl(Fd, TCGETS2, &options) != 0)
+    {
+      return false;
+    }
+
+    options.c_iflag = 0;
+    options.c_oflag = 0;
+    options.c_lflag = 0;
+    options.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+    options.c_ispeed = baud;
+    options.c_ospeed = baud;
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+
+    if(ioctl(Fd, TCSETS2, &options) != 0)
+    {
+      return false;
+    }
+
+    ioctl(Fd, TCFLSH, TCIFLUSH);
+    Start = End = 0;
+    return true;
+  }
+
+  void Begin(unsigned long baud)
+  {
+    Configure(baud);
+  }
+
+  size_t Available()
+  {
+    if(Start == End)
+    {
+      Fill();
+    }
+    return End - Start;
+  }
+
+  size_t Read(uint8_t* buffer, size_t length)
+  {
+    if(Start == End)
+    {
+      Fill();
+    }
+
+    const size_t count = length < End - Start ? length : End - Start;
+    memcpy(buffer, Buffer + Start, count);
+    Start += count;
+    return count;
+  }
+
+  size_t Write(const uint8_t* buffer, size_t length)
+  {
+    size_t written = 0;
+    while(written < length)
+    {
+      const ssize_t result = write(Fd, buffer + written, length - written);
+      if(result > 0)
+      {
+        written += result;
+        continue;
+      }
+
+      if(result < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if(result < 0 && errno == EAGAIN)
+      {
+        struct pollfd request = { Fd, POLLOUT, 0 };
+        poll(&request, 1, 100);
+        continue;
+      }
+
+      break;
+    }
+
+    return written;
+  }
+
+  unsigned long Millis()
+  {
+    return Micros() / 1000;
+  }
+
+  unsigned long Micros()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+  }
+
+  // Sleeps in poll() so it wakes up as soon as the radar sends something
+  void Delay(unsigned long ms)
+  {
+    if(Start != End)
+    {
+      return;
+    }
+
+    struct pollfd request = { Fd, POLLIN, 0 };
+    poll(&request, 1, (int)ms);
+  }
+
+  // One bulk read() for everything the kernel has buffered, up to POSIX_TRANSPORT_BUFFER_SIZE
+  void Fill()
+  {
+    Start = End = 0;
+    if(Fd < 0)
+    {
+      return;
+    }
+
+    ssize_t result;
+    do
+    {
+      result = read(Fd, Buffer, sizeof(Buffer));
+    } while(result < 0 && errno == EINTR);
+
+    if(result > 0)
+    {
+      End = result;
+    }
+  }
+};
+
+inline static struct RadarLink* LinkOf(struct PosixTransport& port)
+{
+  return &port.Link;
+}
+
+#endif
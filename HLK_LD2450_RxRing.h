@@ -0,0 +1,155 @@
+#ifndef HLK_LD2450_RxRing_h
+#define HLK_LD2450_RxRing_h
+
+#include "HLK_LD2450.h"
+
+// Optional single producer / single consumer receive ring
+// The producer (usually the UART RX interrupt) only ever writes Head and Overruns
+// the consumer (the sketch loop) only ever writes Tail, so neither side needs a lock
+//
+// Example on an AVR Mega with Serial1 unused by the sketch (HardwareSerial owns the
+// interrupt otherwise):
+//   static struct RxRing Ring;
+//   ISR(USART1_RX_vect) { RxRing_Push(&Ring, UDR1); }
+//   void loop() { struct Command frame; if(RxRing_ReadCommand(&Ring, &parser, &frame)) { ... } }
+
+// Must be a power of two, defaults to just over 4 radar frames
+#ifndef RX_RING_SIZE
+#define RX_RING_SIZE 128
+#endif
+
+#if (RX_RING_SIZE & (RX_RING_SIZE - 1)) != 0
+#error RX_RING_SIZE must be a power of two
+#endif
+
+// Indices are free running and wrap at their own width, so they have to be able to count
+// past RX_RING_SIZE. Single byte indices are atomic everywhere including AVR, larger rings
+// need 16 bit atomic loads which AVR does not have.
+#if RX_RING_SIZE <= 128
+typedef uint8_t RxRingIndex;
+#else
+typedef uint16_t RxRingIndex;
+#endif
+
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+
+typedef struct RxRing{
+  // Next slot the producer writes, only written by the producer
+  RxRingIndex Head;
+  // Next slot the consumer reads, only written by the consumer
+  RxRingIndex Tail;
+  // Bytes thrown away because the ring was full, only written by the producer
+  uint16_t Overruns;
+  // Most bytes ever waiting in the ring, only written by the producer
+  RxRingIndex HighWater;
+  uint8_t Buffer[RX_RING_SIZE];
+} RxRing;
+
+#define _rx_ring_load(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define _rx_ring_store(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+
+inline static void RxRing_Init(struct RxRing* ring);
+inline static bool RxRing_Push(struct RxRing* ring, uint8_t byte);
+inline static size_t RxRing_Available(const struct RxRing* ring);
+inline static size_t RxRing_Contiguous(const struct RxRing* ring, const uint8_t** view);
+inline static const uint8_t* RxRing_Peek(const struct RxRing* ring, size_t length, uint8_t* scratch);
+inline static void RxRing_Consume(struct RxRing* ring, size_t length);
+inline static bool RxRing_ReadCommand(struct RxRing* ring, struct FrameParser* parser, struct Command* out);
+
+inline static void RxRing_Init(struct RxRing* ring)
+{
+  memset(ring, 0, sizeof(struct RxRing));
+}
+
+// Producer side, safe to call from an interrupt
+// returns false and counts an overrun when the consumer has fallen a full ring behind
+inline static bool RxRing_Push(struct RxRing* ring, uint8_t byte)
+{
+  const RxRingIndex head = ring->Head;
+  const RxRingIndex used = (RxRingIndex)(head - _rx_ring_load(ring->Tail));
+
+  if(used >= RX_RING_SIZE)
+  {
+    ring->Overruns++;
+    return false;
+  }
+
+  if(used >= ring->HighWater)
+  {
+    ring->HighWater = used + 1;
+  }
+
+  ring->Buffer[head & RX_RING_MASK] = byte;
+  _rx_ring_store(ring->Head, (RxRingIndex)(head + 1));
+  return true;
+}
+
+// Consumer side, number of bytes waiting
+inline static size_t RxRing_Available(const struct RxRing* ring)
+{
+  return (RxRingIndex)(_rx_ring_load(ring->Head) - ring->Tail);
+}
+
+// Consumer side, points view at the waiting bytes that can be read without wrapping
+// and returns how many there are
+inline static size_t RxRing_Contiguous(const struct RxRing* ring, const uint8_t** view)
+{
+  const size_t available = RxRing_Available(ring);
+  const size_t offset = ring->Tail & RX_RING_MASK;
+  const size_t untilEnd = RX_RING_SIZE - offset;
+
+  *view = ring->Buffer + offset;
+  return available < untilEnd ? available : untilEnd;
+}
+
+// Consumer side, returns a view of the next length bytes without consuming them
+// points straight into the ring unless the bytes wrap, then they are copied into scratch
+// returns NULL if fewer than length bytes are waiting
+inline static const uint8_t* RxRing_Peek(const struct RxRing* ring, size_t length, uint8_t* scratch)
+{
+  if(RxRing_Available(ring) < length)
+  {
+    return NULL;
+  }
+
+  const uint8_t* view;
+  const size_t contiguous = RxRing_Contiguous(ring, &view);
+  if(contiguous >= length)
+  {
+    return view;
+  }
+
+  memcpy(scratch, view, contiguous);
+  memcpy(scratch + contiguous, ring->Buffer, length - contiguous);
+  return scratch;
+}
+
+// Consumer side, releases length bytes back to the producer
+inline static void RxRing_Consume(struct RxRing* ring, size_t length)
+{
+  _rx_ring_store(ring->Tail, (RxRingIndex)(ring->Tail + length));
+}
+
+// Consumer side, feeds the parser straight out of the ring, a whole frame at a time
+// when it does not wrap, returns true when a complete frame was written to out
+inline static bool RxRing_ReadCommand(struct RxRing* ring, struct FrameParser* parser, struct Command* out)
+{
+  while(!parser->Ready)
+  {
+    const uint8_t* view;
+    const size_t contiguous = RxRing_Contiguous(ring, &view);
+    if(contiguous == 0)
+    {
+      break;
+    }
+
+    RxRing_Consume(ring, FrameParser_Feed(parser, view, contiguous));
+  }
+
+  return FrameParser_Poll(parser, out);
+}
+
+#undef _rx_ring_load
+#undef _rx_ring_store
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef HLK_LD2450_SharedRing_h
+#define HLK_LD2450_SharedRing_h
+
+// Decoded frames in shared memory for any number of reader processes on a Linux gateway
+//
+// One shm object holds a header and a ring of slots, each slot guarded by its own sequence
+// number (a seqlock per slot). Publishers never wait for readers and readers never write to
+// the ring, a reader that falls a whole ring behind finds out from the sequence numbers,
+// counts what it missed and carries on from the oldest frame still there.
+//
+// Publisher:
+//   struct SharedRing ring;
+//   SharedRing_Create(&ring, "/ld2450", 4096);
+//   SharedRing_PublishGroup(&ring, sensor, timestamp_us, &group);
+//
+// Reader (another process):
+//   struct SharedRing ring;
+//   SharedRing_Open(&ring, "/ld2450");
+//   struct SharedRingReader reader;
+//   SharedRingReader_Init(&reader, &ring, true);
+//   struct SharedTargetFrame frame;
+//   while(SharedRingReader_Read(&reader, &frame) != SharedRingRead_Empty) { ... }
+//
+// Readers get their own copy of each frame, a seqlock can only tell that a slot was
+// overwritten after the bytes were read, so they must not be used straight out of the slot.
+
+#if !defined(__linux__)
+#error HLK_LD2450_SharedRing.h uses POSIX shared memory and only supports Linux
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "HLK_LD2450.h"
+
+#define SHARED_RING_MAGIC 0x3432444CUL
+#define SHARED_RING_VERSION 1
+#define SHARED_RING_CACHE_LINE 64
+
+typedef struct SharedTarget{
+  int16_t X;
+  int16_t Y;
+  int16_t Speed;
+  uint16_t DistanceResolution;
+} SharedTarget;
+
+typedef struct SharedTargetFrame{
+  uint64_t Timestamp_us;
+  uint16_t Sensor;
+  // Bit i set when target i is present
+  uint8_t Present;
+  uint8_t Reserved[5];
+  struct SharedTarget Targets[3];
+} SharedTargetFrame;
+
+typedef struct SharedRingSlot{
+  // 2n + 1 while frame n is being written, 2n + 2 once it is complete
+  uint64_t Sequence;
+  struct SharedTargetFrame Frame;
+} __attribute__((aligned(SHARED_RING_CACHE_LINE))) SharedRingSlot;
+
+typedef struct SharedRingHeader{
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t SlotCount;
+  uint32_t SlotSize;
+  // Number of frames ever claimed by publishers, frame n lives in slot n % SlotCount
+  uint64_t Published __attribute__((aligned(SHARED_RING_CACHE_LINE)));
+} __attribute__((aligned(SHARED_RING_CACHE_LINE))) SharedRingHeader;
+
+// A mapping of the ring, one per process
+typedef struct SharedRing{
+  struct SharedRingHeader* Header;
+  struct SharedRingSlot* Slots;
+  size_t MappedSize;
+  uint64_t Mask;
+} SharedRing;
+
+typedef struct SharedRingReader{
+  const struct SharedRing* Ring;
+  // Next frame number to read
+  uint64_t Next;
+  // Frames overwritten before this reader got to them
+  uint64_t Lost;
+} SharedRingReader;
+
+typedef enum SharedRingReadResult{
+  SharedRingRead_Ok = 0x0,
+  // Nothing new yet
+  SharedRingRead_Empty = 0x1,
+  // The reader fell behind, Lost went up and the next read continues from the oldest frame left
+  SharedRingRead_Overrun = 0x2
+} SharedRingReadResult;
+
+inline static bool SharedRing_Create(struct SharedRing* ring, const char* name, uint32_t slotCount);
+inline static bool SharedRing_Open(struct SharedRing* ring, const char* name);
+inline static void SharedRing_Close(struct SharedRing* ring);
+inline static void SharedRing_Publish(struct SharedRing* ring, const struct SharedTargetFrame* frame);
+inline static void SharedRing_PublishGroup(struct SharedRing* ring, uint16_t sensor, uint64_t timestamp_us, const struct TrackedObjectGroup* group);
+inline static void SharedRingReader_Init(struct SharedRingReader* reader, const struct SharedRing* ring, bool fromLatest);
+inline static SharedRingReadResult SharedRingReader_Read(struct SharedRingReader* reader, struct SharedTargetFrame* out);
+
+inline static bool _SharedRing_Map(struct SharedRing* ring, int fd, size_t size, int protection)
+{
+  void* mapping = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    return false;
+  }
+
+  ring->Header = (struct SharedRingHeader*)mapping;
+  ring->Slots = (struct SharedRingSlot*)((uint8_t*)mapping + sizeof(struct SharedRingHeader));
+  ring->MappedSize = size;
+  return true;
+}
+
+// Creates (or replaces) the shm object, slotCount must be a power of two
+// returns false on failure (see errno)
+inline static bool SharedRing_Create(struct SharedRing* ring, const char* name, uint32_t slotCount)
+{
+  memset(ring, 0, sizeof(struct SharedRing));
+  if(slotCount == 0 || (slotCount & (slotCount - 1)) != 0)
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  const size_t size = sizeof(struct SharedRingHeader) + (size_t)slotCount * sizeof(struct SharedRingSlot);
+  shm_unlink(name);
+  const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  if(ftruncate(fd, size) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  // ftruncate zero fills, so every slot starts at sequence 0 (nothing written)
+  struct SharedRingHeader* header = (struct SharedRingHeader*)mmap(NULL, sizeof(struct SharedRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(header == MAP_FAILED)
+  {
+    close(fd);
+    return false;
+  }
+  header->SlotCount = slotCount;
+  header->SlotSize = sizeof(struct SharedRingSlot);
+  header->Version = SHARED_RING_VERSION;
+  __atomic_store_n(&header->Magic, SHARED_RING_MAGIC, __ATOMIC_RELEASE);
+  munmap(header, sizeof(struct SharedRingHeader));
+
+  if(!_SharedRing_Map(ring, fd, size, PROT_READ | PROT_WRITE))
+  {
+    return false;
+  }
+
+  ring->Mask = slotCount - 1;
+  return true;
+}
+
+// Maps an existing ring read only, returns false if it doesn't exist or isn't a ring of this version
+inline static bool SharedRing_Open(struct SharedRing* ring, const char* name)
+{
+  memset(ring, 0, sizeof(struct SharedRing));
+  const int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(struct SharedRingHeader))
+  {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+
+  if(!_SharedRing_Map(ring, fd, info.st_size, PROT_READ))
+  {
+    return false;
+  }
+
+  // the slot count comes from whoever wrote the object, the index mask is only valid for a nonzero power of two
+  const struct SharedRingHeader* header = ring->Header;
+  const uint32_t slotCount = header->SlotCount;
+  if(__atomic_load_n(&header->Magic, __ATOMIC_ACQUIRE) != SHARED_RING_MAGIC || header->Version != SHARED_RING_VERSION ||
+     header->SlotSize != sizeof(struct SharedRingSlot) || slotCount == 0 || (slotCount & (slotCount - 1)) != 0 ||
+     ring->MappedSize < sizeof(struct SharedRingHeader) + (size_t)slotCount * sizeof(struct SharedRingSlot))
+  {
+    SharedRing_Close(ring);
+    errno = EINVAL;
+    return false;
+  }
+
+  ring->Mask = slotCount - 1;
+  return true;
+}
+
+inline static void SharedRing_Close(struct SharedRing* ring)
+{
+  if(ring->Header != NULL)
+  {
+    munmap(ring->Header, ring->MappedSize);
+  }
+  memset(ring, 0, sizeof(struct SharedRing));
+}
+
+// Several publishers may share a ring, each frame gets its own number so they only collide if
+// the ring laps completely while one of them is in the middle of writing a slot
+inline static void SharedRing_Publish(struct SharedRing* ring, const struct SharedTargetFrame* frame)
+{
+  const uint64_t number = __atomic_fetch_add(&ring->Header->Published, 1, __ATOMIC_RELAXED);
+  struct SharedRingSlot* slot = &ring->Slots[number & ring->Mask];
+
+  __atomic_store_n(&slot->Sequence, number * 2 + 1, __ATOMIC_RELAXED);
+  // the odd sequence has to be visible before any of the new bytes
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&slot->Frame, frame, sizeof(struct SharedTargetFrame));
+  __atomic_store_n(&slot->Sequence, number * 2 + 2, __ATOMIC_RELEASE);
+}
+
+inline static void SharedRing_PublishGroup(struct SharedRing* ring, uint16_t sensor, uint64_t timestamp_us, const struct TrackedObjectGroup* group)
+{
+  struct SharedTargetFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.Timestamp_us = timestamp_us;
+  frame.Sensor = sensor;
+
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    frame.Present |= objects[i]->Present << i;
+    frame.Targets[i].X = objects[i]->X;
+    frame.Targets[i].Y = objects[i]->Y;
+    frame.Targets[i].Speed = objects[i]->Speed;
+    frame.Targets[i].DistanceResolution = objects[i]->DistanceResolution;
+  }
+
+  SharedRing_Publish(ring, &frame);
+}
+
+// fromLatest skips everything already in the ring, otherwise reading starts at the oldest frame kept
+inline static void SharedRingReader_Init(struct SharedRingReader* reader, const struct SharedRing* ring, bool fromLatest)
+{
+  const uint64_t published = __atomic_load_n(&ring->Header->Published, __ATOMIC_ACQUIRE);
+  const uint64_t slots = ring->Mask + 1;
+
+  reader->Ring = ring;
+  reader->Lost = 0;
+  if(fromLatest)
+  {
+    reader->Next = published;
+  }
+  else
+  {
+    reader->Next = published > slots ? published - slots : 0;
+  }
+}
+
+inline static SharedRingReadResult SharedRingReader_Read(struct SharedRingReader* reader, struct SharedTargetFrame* out)
+{
+  const struct SharedRing* ring = reader->Ring;
+  const struct SharedRingSlot* slot = &ring->Slots[reader->Next & ring->Mask];
+  const uint64_t expected = reader->Next * 2 + 2;
+
+  const uint64_t before = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE);
+  if(before == expected)
+  {
+    memcpy(out, &slot->Frame, sizeof(struct SharedTargetFrame));
+    // the copy has to be finished before the sequence is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->Sequence, __ATOMIC_RELAXED) == expected)
+    {
+      reader->Next++;
+      return SharedRingRead_Ok;
+    }
+  }
+  else if(before < expected)
+  {
+    // frame Next is still being written, or was never published
+    return SharedRingRead_Empty;
+  }
+
+  // lapped, move to the oldest frame that is still safe to read
+  const uint64_t published = __atomic_load_n(&ring->Header->Published, __ATOMIC_ACQUIRE);
+  const uint64_t slots = ring->Mask + 1;
+  const uint64_t oldest = published > slots ? published - slots + 1 : 0;
+  if(oldest > reader->Next)
+  {
+    reader->Lost += oldest - reader->Next;
+    reader->Next = oldest;
+  }
+  else
+  {
+    reader->Lost++;
+    reader->Next++;
+  }
+  return SharedRingRead_Overrun;
+}
+
+#endif
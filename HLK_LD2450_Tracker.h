@@ -0,0 +1,334 @@
+#ifndef HLK_LD2450_Tracker_h
+#define HLK_LD2450_Tracker_h
+
+#include "HLK_LD2450.h"
+
+// Gives targets an id that stays with them from frame to frame
+// The radar reports up to 3 anonymous slots and may reorder them between frames. Every frame
+// each track is moved to where its velocity says it should be, detections are matched to the
+// nearest predicted track inside a gate, and the matched tracks are corrected with an alpha-beta
+// filter. Unmatched detections start tentative tracks that get an id once they have been seen
+// TRACKER_CONFIRM_HITS times, tracks that go unmatched coast on their velocity and are dropped
+// after TRACKER_MAX_MISSES frames. Integer math only, so it runs the same on MCUs without an FPU.
+//
+//   static struct Tracker tracker;
+//   Tracker_Init(&tracker, NULL);
+//
+//   struct TrackedObjectGroup group = GetTrackedObjects();
+//   struct TrackedTarget targets[TRACKER_MAX_TRACKS];
+//   uint8_t count = Tracker_Update(&tracker, &group, millis(), targets);
+//   for(uint8_t i = 0; i < count; i++) { targets[i].Id ... }
+
+// Tracks kept at once, more than 3 so people can coast through a missed detection
+// while someone new is picked up
+#ifndef TRACKER_MAX_TRACKS
+#if defined(__AVR__)
+#define TRACKER_MAX_TRACKS 4
+#else
+#define TRACKER_MAX_TRACKS 8
+#endif
+#endif
+
+// Positions and velocities carry this many fraction bits, 1/16mm and 1/16mm/s
+#define TRACKER_FRACTION_BITS 4
+
+// Gains are fractions of 256
+#ifndef TRACKER_ALPHA
+#define TRACKER_ALPHA 128
+#endif
+
+#ifndef TRACKER_BETA
+#define TRACKER_BETA 40
+#endif
+
+// Largest distance between a prediction and a detection that can still be the same target
+#ifndef TRACKER_GATE_MM
+#define TRACKER_GATE_MM 600
+#endif
+
+#ifndef TRACKER_CONFIRM_HITS
+#define TRACKER_CONFIRM_HITS 3
+#endif
+
+#ifndef TRACKER_MAX_MISSES
+#define TRACKER_MAX_MISSES 5
+#endif
+
+// Velocities are clamped to this, faster than anyone walks through a room
+#define TRACKER_MAX_SPEED_MMS 5000
+// Longer gaps between frames are treated as this long so predictions stay in range
+#define TRACKER_MAX_STEP_MS 1000
+// Keeps the squared distances in 32 bits
+#define TRACKER_MAX_GATE_MM 40000
+// Distance of a pair that can't be matched, UINT32_MAX isn't defined in C++ on AVR
+#define TRACKER_NO_MATCH 0xFFFFFFFFUL
+
+typedef struct TrackerSettings{
+  // Position and velocity gains, fractions of 256
+  uint8_t Alpha;
+  uint8_t Beta;
+  uint16_t Gate_mm;
+  uint8_t ConfirmHits;
+  uint8_t MaxMisses;
+} TrackerSettings;
+
+static const struct TrackerSettings DefaultTrackerSettings = { TRACKER_ALPHA, TRACKER_BETA, TRACKER_GATE_MM, TRACKER_CONFIRM_HITS, TRACKER_MAX_MISSES };
+
+typedef enum TrackState{
+  TrackState_Free = 0x0,
+  // Seen fewer than ConfirmHits times, no id yet
+  TrackState_Tentative = 0x1,
+  TrackState_Confirmed = 0x2
+} TrackState;
+
+typedef struct Track{
+  uint8_t State;
+  uint8_t Hits;
+  // Frames in a row without a detection
+  uint8_t Misses;
+  // 0 until confirmed
+  uint16_t Id;
+  // millimeters and millimeters per second, TRACKER_FRACTION_BITS fraction bits
+  int32_t X;
+  int32_t Y;
+  int32_t Vx;
+  int32_t Vy;
+} Track;
+
+// What Tracker_Update reports for each confirmed track
+typedef struct TrackedTarget{
+  uint16_t Id;
+  int16_t X;
+  int16_t Y;
+  // mm/s
+  int16_t Vx;
+  int16_t Vy;
+  // 0 when a detection was matched this frame, otherwise the track is coasting
+  uint8_t Misses;
+} TrackedTarget;
+
+typedef struct Tracker{
+  struct TrackerSettings Settings;
+  struct Track Tracks[TRACKER_MAX_TRACKS];
+  uint16_t NextId;
+  unsigned long Last_ms;
+  bool Started;
+} Tracker;
+
+inline static void Tracker_Init(struct Tracker* tracker, const struct TrackerSettings* settings);
+inline static uint8_t Tracker_Update(struct Tracker* tracker, const struct TrackedObjectGroup* group, unsigned long now_ms, struct TrackedTarget* out);
+
+// settings may be NULL for DefaultTrackerSettings
+inline static void Tracker_Init(struct Tracker* tracker, const struct TrackerSettings* settings)
+{
+  memset(tracker, 0, sizeof(struct Tracker));
+  tracker->Settings = settings != NULL ? *settings : DefaultTrackerSettings;
+  if(tracker->Settings.Gate_mm > TRACKER_MAX_GATE_MM)
+  {
+    tracker->Settings.Gate_mm = TRACKER_MAX_GATE_MM;
+  }
+  tracker->NextId = 1;
+}
+
+inline static int32_t _TrackerClamp(int32_t value, int32_t limit)
+{
+  return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+// Moves every track along its velocity by dt_ms
+inline static void _Tracker_Predict(struct Tracker* tracker, int32_t dt_ms)
+{
+  for(uint8_t i = 0; i < TRACKER_MAX_TRACKS; i++)
+  {
+    struct Track* track = &tracker->Tracks[i];
+    if(track->State == TrackState_Free)
+    {
+      continue;
+    }
+
+    // at most 5000mm/s * 16 * 1000ms, well inside 32 bits
+    track->X += track->Vx * dt_ms / 1000;
+    track->Y += track->Vy * dt_ms / 1000;
+  }
+}
+
+// Squared distance in mm between a track's prediction and a detection, TRACKER_NO_MATCH outside the gate
+inline static uint32_t _Tracker_Distance(const struct Tracker* tracker, const struct Track* track, const struct TrackedObject* object)
+{
+  const int32_t dx = (track->X >> TRACKER_FRACTION_BITS) - object->X;
+  const int32_t dy = (track->Y >> TRACKER_FRACTION_BITS) - object->Y;
+  const uint32_t gate = tracker->Settings.Gate_mm;
+  const uint32_t x = dx < 0 ? -dx : dx;
+  const uint32_t y = dy < 0 ? -dy : dy;
+  if(x > gate || y > gate)
+  {
+    return TRACKER_NO_MATCH;
+  }
+
+  const uint32_t distance = x * x + y * y;
+  return distance > gate * gate ? TRACKER_NO_MATCH : distance;
+}
+
+// Gives a tentative track that has been seen often enough its id
+inline static void _Tracker_Confirm(struct Tracker* tracker, struct Track* track)
+{
+  if(track->State != TrackState_Tentative || track->Hits < tracker->Settings.ConfirmHits)
+  {
+    return;
+  }
+
+  track->State = TrackState_Confirmed;
+  track->Id = tracker->NextId++;
+  // 0 means no id
+  if(tracker->NextId == 0)
+  {
+    tracker->NextId = 1;
+  }
+}
+
+inline static void _Tracker_Correct(struct Tracker* tracker, struct Track* track, const struct TrackedObject* object, int32_t dt_ms)
+{
+  const int32_t limit = (int32_t)TRACKER_MAX_SPEED_MMS << TRACKER_FRACTION_BITS;
+  const int32_t rx = ((int32_t)object->X << TRACKER_FRACTION_BITS) - track->X;
+  const int32_t ry = ((int32_t)object->Y << TRACKER_FRACTION_BITS) - track->Y;
+
+  track->X += rx * tracker->Settings.Alpha >> 8;
+  track->Y += ry * tracker->Settings.Alpha >> 8;
+  // the residual over the time it built up in is the velocity error
+  track->Vx = _TrackerClamp(track->Vx + (rx * tracker->Settings.Beta >> 8) * 1000 / dt_ms, limit);
+  track->Vy = _TrackerClamp(track->Vy + (ry * tracker->Settings.Beta >> 8) * 1000 / dt_ms, limit);
+
+  track->Misses = 0;
+  if(track->Hits < 0xFF)
+  {
+    track->Hits++;
+  }
+  _Tracker_Confirm(tracker, track);
+}
+
+inline static void _Tracker_Start(struct Tracker* tracker, const struct TrackedObject* object)
+{
+  for(uint8_t i = 0; i < TRACKER_MAX_TRACKS; i++)
+  {
+    struct Track* track = &tracker->Tracks[i];
+    if(track->State != TrackState_Free)
+    {
+      continue;
+    }
+
+    memset(track, 0, sizeof(struct Track));
+    track->State = TrackState_Tentative;
+    track->Hits = 1;
+    track->X = (int32_t)object->X << TRACKER_FRACTION_BITS;
+    track->Y = (int32_t)object->Y << TRACKER_FRACTION_BITS;
+    _Tracker_Confirm(tracker, track);
+    return;
+  }
+}
+
+// Runs one frame through the tracker, writes the confirmed tracks to out (room for
+// TRACKER_MAX_TRACKS) and returns how many there are
+inline static uint8_t Tracker_Update(struct Tracker* tracker, const struct TrackedObjectGroup* group, unsigned long now_ms, struct TrackedTarget* out)
+{
+  int32_t dt_ms = tracker->Started ? (int32_t)(now_ms - tracker->Last_ms) : 100;
+  dt_ms = dt_ms < 1 ? 1 : dt_ms > TRACKER_MAX_STEP_MS ? TRACKER_MAX_STEP_MS : dt_ms;
+  tracker->Last_ms = now_ms;
+  tracker->Started = true;
+
+  _Tracker_Predict(tracker, dt_ms);
+
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+  uint32_t distances[3][TRACKER_MAX_TRACKS];
+  for(uint8_t d = 0; d < 3; d++)
+  {
+    for(uint8_t t = 0; t < TRACKER_MAX_TRACKS; t++)
+    {
+      const struct Track* track = &tracker->Tracks[t];
+      distances[d][t] = objects[d]->Present && track->State != TrackState_Free ? _Tracker_Distance(tracker, track, objects[d]) : TRACKER_NO_MATCH;
+    }
+  }
+
+  // greedy nearest neighbour, closest pair first, at most 3 rounds of 3 x TRACKER_MAX_TRACKS
+  // confirmed tracks win ties so a tentative one can't steal a known person
+  bool matchedTrack[TRACKER_MAX_TRACKS] = {};
+  bool matchedObject[3] = {};
+  for(uint8_t round = 0; round < 3; round++)
+  {
+    uint32_t best = TRACKER_NO_MATCH;
+    uint8_t bestObject = 0;
+    uint8_t bestTrack = 0;
+    for(uint8_t d = 0; d < 3; d++)
+    {
+      for(uint8_t t = 0; t < TRACKER_MAX_TRACKS; t++)
+      {
+        const uint32_t distance = distances[d][t];
+        if(matchedObject[d] || matchedTrack[t] || distance == TRACKER_NO_MATCH)
+        {
+          continue;
+        }
+
+        const bool confirmed = tracker->Tracks[t].State == TrackState_Confirmed;
+        if(distance < best || (distance == best && confirmed))
+        {
+          best = distance;
+          bestObject = d;
+          bestTrack = t;
+        }
+      }
+    }
+
+    if(best == TRACKER_NO_MATCH)
+    {
+      break;
+    }
+
+    matchedObject[bestObject] = true;
+    matchedTrack[bestTrack] = true;
+    _Tracker_Correct(tracker, &tracker->Tracks[bestTrack], objects[bestObject], dt_ms);
+  }
+
+  for(uint8_t t = 0; t < TRACKER_MAX_TRACKS; t++)
+  {
+    struct Track* track = &tracker->Tracks[t];
+    if(track->State == TrackState_Free || matchedTrack[t])
+    {
+      continue;
+    }
+
+    // tentative tracks that miss were most likely noise
+    if(track->State == TrackState_Tentative || ++track->Misses > tracker->Settings.MaxMisses)
+    {
+      track->State = TrackState_Free;
+    }
+  }
+
+  for(uint8_t d = 0; d < 3; d++)
+  {
+    if(objects[d]->Present && !matchedObject[d])
+    {
+      _Tracker_Start(tracker, objects[d]);
+    }
+  }
+
+  uint8_t count = 0;
+  for(uint8_t t = 0; t < TRACKER_MAX_TRACKS; t++)
+  {
+    const struct Track* track = &tracker->Tracks[t];
+    if(track->State != TrackState_Confirmed)
+    {
+      continue;
+    }
+
+    struct TrackedTarget* target = &out[count++];
+    target->Id = track->Id;
+    target->X = track->X >> TRACKER_FRACTION_BITS;
+    target->Y = track->Y >> TRACKER_FRACTION_BITS;
+    target->Vx = track->Vx >> TRACKER_FRACTION_BITS;
+    target->Vy = track->Vy >> TRACKER_FRACTION_BITS;
+    target->Misses = track->Misses;
+  }
+
+  return count;
+}
+
+#endif
@@ -0,0 +1,443 @@
+#ifndef HLK_LD2450_Uplink_h
+#define HLK_LD2450_Uplink_h
+
+#include "HLK_LD2450.h"
+
+// Sends decoded targets upstream (USB serial, UART to a gateway, radio) as small binary frames
+// instead of decimal text. A frame is a sequence number, a timestamp and the three targets of one
+// radar. Most frames only carry the change since that radar's previous frame as zigzag varints,
+// usually 8 to 15 bytes for a frame with people in it against over 170 from LogTrackedObjectGroup. Every
+// KeyframeInterval frames a keyframe carries everything so a receiver that joins late or lost a
+// frame picks the stream up again. Several radars share one link, each frame names its sensor.
+//
+// Frame, the CRC is CRC-16/CCITT-FALSE over length and payload:
+//   u8 0xB5 | u8 payload length | payload | u16 CRC, little endian
+// Payload:
+//   u8 sensor | u8 flags: bit 0 keyframe, bits 1..3 First, Second, Third present
+//   keyframe: varint sequence | varint time ms
+//   otherwise: u8 low byte of the sequence, which is one after the previous frame's | varint ms since the previous frame
+//   per present target: zigzag varints X, Y, Speed, DistanceResolution, as the change since the
+//   previous frame when the target was present in it and this is not a keyframe, else as they are
+//
+// On the microcontroller, one encoder per radar:
+//   static struct UplinkEncoder uplink;
+//   UplinkEncoder_Init(&uplink, 0, 0);
+//   struct TrackedObjectGroup group = GetTrackedObjects();
+//   Uplink_Send(usb, &uplink, &group, millis());   // any transport, e.g. ArduinoTransport<HardwareSerial>
+//
+// On the receiving side (see extras/linux/ld2450_uplink.cpp):
+//   static struct UplinkDecoder decoder;
+//   UplinkDecoder_Init(&decoder);
+//   size_t used = UplinkDecoder_Feed(&decoder, bytes, length);
+//   struct UplinkFrame frame;
+//   while(UplinkDecoder_Poll(&decoder, &frame)) { ... frame.Sensor, frame.Sequence, frame.Group ... }
+
+#define UPLINK_MAGIC 0xB5
+
+// sensor, flags, sequence and time as 5 byte varints, 3 targets of 4 values of up to 3 bytes
+#define UPLINK_MAX_PAYLOAD (2 + 5 + 5 + 3 * 4 * 3)
+#define UPLINK_MAX_FRAME (2 + UPLINK_MAX_PAYLOAD + 2)
+
+// Frames between keyframes, a receiver that lost a frame is back this many frames later
+#ifndef UPLINK_KEYFRAME_INTERVAL
+#define UPLINK_KEYFRAME_INTERVAL 10
+#endif
+
+// Sensor ids a decoder keeps state for, frames from higher ids are dropped
+#ifndef UPLINK_MAX_SENSORS
+#if defined(__AVR__)
+#define UPLINK_MAX_SENSORS 4
+#else
+#define UPLINK_MAX_SENSORS 256
+#endif
+#endif
+
+#define UPLINK_FLAG_KEYFRAME 0x1
+
+typedef struct UplinkTarget{
+  bool Present;
+  int16_t X;
+  int16_t Y;
+  int16_t Speed;
+  uint16_t DistanceResolution;
+} UplinkTarget;
+
+// What both ends remember of a sensor's previous frame
+typedef struct UplinkState{
+  bool Valid;
+  uint32_t Sequence;
+  uint32_t Time_ms;
+  struct UplinkTarget Targets[3];
+} UplinkState;
+
+typedef struct UplinkEncoder{
+  uint8_t Sensor;
+  uint8_t KeyframeInterval;
+  // Frames since the last keyframe
+  uint8_t SinceKeyframe;
+  struct UplinkState State;
+} UplinkEncoder;
+
+typedef struct UplinkFrame{
+  uint8_t Sensor;
+  bool Keyframe;
+  uint32_t Sequence;
+  uint32_t Time_ms;
+  struct TrackedObjectGroup Group;
+} UplinkFrame;
+
+typedef struct UplinkDecoder{
+  struct UplinkState Sensors[UPLINK_MAX_SENSORS];
+  // Bytes of the frame being received, Buffer[0..Index)
+  uint8_t Buffer[UPLINK_MAX_FRAME];
+  uint8_t Index;
+  bool Ready;
+  struct UplinkFrame Frame;
+  uint32_t Frames;
+  // Frames thrown away because the CRC or their contents were wrong
+  uint32_t Corrupt;
+  // Frames thrown away because the frame before them was lost, until the next keyframe
+  uint32_t Missed;
+} UplinkDecoder;
+
+inline static void UplinkEncoder_Init(struct UplinkEncoder* encoder, uint8_t sensor, uint8_t keyframeInterval);
+inline static uint8_t UplinkEncoder_Encode(struct UplinkEncoder* encoder, const struct TrackedObjectGroup* group, uint32_t time_ms, uint8_t* out);
+inline static void UplinkDecoder_Init(struct UplinkDecoder* decoder);
+inline static size_t UplinkDecoder_Feed(struct UplinkDecoder* decoder, const uint8_t* bytes, size_t length);
+inline static bool UplinkDecoder_Poll(struct UplinkDecoder* decoder, struct UplinkFrame* out);
+inline static uint16_t Uplink_Crc16(uint16_t crc, const uint8_t* bytes, size_t length);
+
+// CRC-16/CCITT-FALSE without a table, a few shifts per byte
+inline static uint16_t Uplink_Crc16(uint16_t crc, const uint8_t* bytes, size_t length)
+{
+  for(size_t i = 0; i < length; i++)
+  {
+    crc = (uint16_t)((crc >> 8) | (crc << 8));
+    crc ^= bytes[i];
+    crc ^= (uint8_t)(crc & 0xFF) >> 4;
+    crc ^= (uint16_t)(crc << 12);
+    crc ^= (uint16_t)((crc & 0xFF) << 5);
+  }
+  return crc;
+}
+
+inline static uint8_t* _Uplink_PutVarint(uint8_t* out, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+inline static uint8_t* _Uplink_PutSigned(uint8_t* out, int32_t value)
+{
+  return _Uplink_PutVarint(out, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+// returns NULL when the varint runs past end or is longer than 5 bytes
+inline static const uint8_t* _Uplink_GetVarint(const uint8_t* in, const uint8_t* end, uint32_t* value)
+{
+  *value = 0;
+  for(uint8_t shift = 0; shift < 35 && in < end; shift += 7)
+  {
+    const uint8_t byte = *in++;
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if((byte & 0x80) == 0)
+    {
+      return in;
+    }
+  }
+  return NULL;
+}
+
+inline static const uint8_t* _Uplink_GetSigned(const uint8_t* in, const uint8_t* end, int32_t* value)
+{
+  uint32_t zigzag;
+  in = _Uplink_GetVarint(in, end, &zigzag);
+  *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+  return in;
+}
+
+// keyframeInterval 0 for UPLINK_KEYFRAME_INTERVAL, 1 makes every frame a keyframe
+inline static void UplinkEncoder_Init(struct UplinkEncoder* encoder, uint8_t sensor, uint8_t keyframeInterval)
+{
+  memset(encoder, 0, sizeof(struct UplinkEncoder));
+  encoder->Sensor = sensor;
+  encoder->KeyframeInterval = keyframeInterval != 0 ? keyframeInterval : UPLINK_KEYFRAME_INTERVAL;
+}
+
+// Writes the next frame for group into out, which needs UPLINK_MAX_FRAME bytes, returns its size
+inline static uint8_t UplinkEncoder_Encode(struct UplinkEncoder* encoder, const struct TrackedObjectGroup* group, uint32_t time_ms, uint8_t* out)
+{
+  struct UplinkState* state = &encoder->State;
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+  const bool keyframe = !state->Valid || encoder->SinceKeyframe + 1 >= encoder->KeyframeInterval;
+  const uint32_t sequence = state->Sequence + 1;
+
+  uint8_t flags = keyframe ? UPLINK_FLAG_KEYFRAME : 0;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    flags |= objects[i]->Present ? 2 << i : 0;
+  }
+
+  uint8_t* at = out + 2;
+  *at++ = encoder->Sensor;
+  *at++ = flags;
+  if(keyframe)
+  {
+    at = _Uplink_PutVarint(at, sequence);
+    at = _Uplink_PutVarint(at, time_ms);
+  }
+  else
+  {
+    *at++ = (uint8_t)sequence;
+    at = _Uplink_PutVarint(at, time_ms - state->Time_ms);
+  }
+
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    struct UplinkTarget* last = &state->Targets[i];
+    const struct TrackedObject* object = objects[i];
+    if(!object->Present)
+    {
+      last->Present = false;
+      continue;
+    }
+
+    // a target that was there last frame has moved a little, one that wasn't could be anywhere
+    const bool delta = !keyframe && last->Present;
+    at = _Uplink_PutSigned(at, (int32_t)object->X - (delta ? last->X : 0));
+    at = _Uplink_PutSigned(at, (int32_t)object->Y - (delta ? last->Y : 0));
+    at = _Uplink_PutSigned(at, (int32_t)object->Speed - (delta ? last->Speed : 0));
+    at = _Uplink_PutSigned(at, (int32_t)(uint16_t)object->DistanceResolution - (delta ? last->DistanceResolution : 0));
+
+    last->Present = true;
+    last->X = object->X;
+    last->Y = object->Y;
+    last->Speed = object->Speed;
+    last->DistanceResolution = object->DistanceResolution;
+  }
+
+  const uint8_t payload = (uint8_t)(at - out - 2);
+  out[0] = UPLINK_MAGIC;
+  out[1] = payload;
+  const uint16_t crc = Uplink_Crc16(0xFFFF, out + 1, payload + 1);
+  *at++ = (uint8_t)crc;
+  *at++ = (uint8_t)(crc >> 8);
+
+  state->Valid = true;
+  state->Sequence = sequence;
+  state->Time_ms = time_ms;
+  encoder->SinceKeyframe = keyframe ? 0 : encoder->SinceKeyframe + 1;
+  return (uint8_t)(at - out);
+}
+
+// Encodes group and writes it to port, any transport with Write will do
+template<typename Transport>
+inline static size_t Uplink_Send(Transport& port, struct UplinkEncoder* encoder, const struct TrackedObjectGroup* group, uint32_t time_ms)
+{
+  uint8_t frame[UPLINK_MAX_FRAME];
+  const uint8_t length = UplinkEncoder_Encode(encoder, group, time_ms, frame);
+  return port.Write(frame, length);
+}
+
+inline static void UplinkDecoder_Init(struct UplinkDecoder* decoder)
+{
+  memset(decoder, 0, sizeof(struct UplinkDecoder));
+}
+
+// Applies a payload that passed its CRC to the sensor's state
+// returns false when it is malformed, or a delta against a frame this decoder never saw
+inline static bool _UplinkDecoder_Apply(struct UplinkDecoder* decoder, const uint8_t* payload, uint8_t length)
+{
+  if(length < 3)
+  {
+    decoder->Corrupt++;
+    return false;
+  }
+
+  const uint8_t* end = payload + length;
+  const uint8_t* at = payload + 2;
+  const uint8_t sensor = payload[0];
+  const uint8_t flags = payload[1];
+  const bool keyframe = (flags & UPLINK_FLAG_KEYFRAME) != 0;
+  // with 256 sensors every id is in range
+#if UPLINK_MAX_SENSORS < 256
+  if(sensor >= UPLINK_MAX_SENSORS)
+  {
+    decoder->Corrupt++;
+    return false;
+  }
+#endif
+  if((flags & 0xF0) != 0)
+  {
+    decoder->Corrupt++;
+    return false;
+  }
+
+  struct UplinkState* state = &decoder->Sensors[sensor];
+  // decode into a copy so a malformed frame leaves the state alone
+  struct UplinkState next = *state;
+  if(keyframe)
+  {
+    at = _Uplink_GetVarint(at, end, &next.Sequence);
+    at = at != NULL ? _Uplink_GetVarint(at, end, &next.Time_ms) : NULL;
+  }
+  else
+  {
+    if(!state->Valid || (uint8_t)(state->Sequence + 1) != *at++)
+    {
+      state->Valid = false;
+      decoder->Missed++;
+      return false;
+    }
+
+    uint32_t elapsed;
+    at = _Uplink_GetVarint(at, end, &elapsed);
+    next.Sequence = state->Sequence + 1;
+    next.Time_ms = state->Time_ms + elapsed;
+  }
+
+  for(uint8_t i = 0; i < 3 && at != NULL; i++)
+  {
+    struct UplinkTarget* target = &next.Targets[i];
+    if((flags & (2 << i)) == 0)
+    {
+      target->Present = false;
+      continue;
+    }
+
+    const bool delta = !keyframe && target->Present;
+    int32_t values[4];
+    for(uint8_t v = 0; v < 4 && at != NULL; v++)
+    {
+      at = _Uplink_GetSigned(at, end, &values[v]);
+    }
+    if(at == NULL)
+    {
+      break;
+    }
+
+    target->Present = true;
+    target->X = (int16_t)(values[0] + (delta ? target->X : 0));
+    target->Y = (int16_t)(values[1] + (delta ? target->Y : 0));
+    target->Speed = (int16_t)(values[2] + (delta ? target->Speed : 0));
+    target->DistanceResolution = (uint16_t)(values[3] + (delta ? target->DistanceResolution : 0));
+  }
+
+  if(at != end)
+  {
+    decoder->Corrupt++;
+    return false;
+  }
+
+  next.Valid = true;
+  *state = next;
+
+  struct UplinkFrame* frame = &decoder->Frame;
+  struct TrackedObject* objects[3] = { &frame->Group.First, &frame->Group.Second, &frame->Group.Third };
+  frame->Sensor = sensor;
+  frame->Keyframe = keyframe;
+  frame->Sequence = next.Sequence;
+  frame->Time_ms = next.Time_ms;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    const struct UplinkTarget* target = &next.Targets[i];
+    objects[i]->Present = target->Present;
+    objects[i]->X = target->Present ? target->X : 0;
+    objects[i]->Y = target->Present ? target->Y : 0;
+    objects[i]->Speed = target->Present ? target->Speed : 0;
+    objects[i]->DistanceResolution = target->Present ? target->DistanceResolution : 0;
+  }
+
+  decoder->Frames++;
+  return true;
+}
+
+// Drops the first buffered byte and everything up to the next possible frame start
+inline static void _UplinkDecoder_Skip(struct UplinkDecoder* decoder)
+{
+  uint8_t start = 1;
+  while(start < decoder->Index && decoder->Buffer[start] != UPLINK_MAGIC)
+  {
+    start++;
+  }
+  decoder->Index -= start;
+  memmove(decoder->Buffer, decoder->Buffer + start, decoder->Index);
+}
+
+// Looks for a complete frame in what is buffered, leaves it in Frame and sets Ready
+inline static void _UplinkDecoder_Scan(struct UplinkDecoder* decoder)
+{
+  while(decoder->Index > 0 && !decoder->Ready)
+  {
+    if(decoder->Buffer[0] != UPLINK_MAGIC)
+    {
+      _UplinkDecoder_Skip(decoder);
+      continue;
+    }
+
+    if(decoder->Index < 2)
+    {
+      return;
+    }
+
+    const uint8_t payload = decoder->Buffer[1];
+    if(payload < 3 || payload > UPLINK_MAX_PAYLOAD)
+    {
+      _UplinkDecoder_Skip(decoder);
+      continue;
+    }
+
+    const uint8_t size = payload + 4;
+    if(decoder->Index < size)
+    {
+      return;
+    }
+
+    const uint16_t crc = decoder->Buffer[size - 2] | (uint16_t)decoder->Buffer[size - 1] << 8;
+    if(Uplink_Crc16(0xFFFF, decoder->Buffer + 1, payload + 1) != crc)
+    {
+      // the magic byte was noise or the frame was damaged, a real frame may start inside it
+      decoder->Corrupt++;
+      _UplinkDecoder_Skip(decoder);
+      continue;
+    }
+
+    decoder->Ready = _UplinkDecoder_Apply(decoder, decoder->Buffer + 2, payload);
+    decoder->Index -= size;
+    memmove(decoder->Buffer, decoder->Buffer + size, decoder->Index);
+  }
+}
+
+// Takes bytes from the link until a frame is complete, returns how many were used
+// Poll the frame before feeding the rest
+inline static size_t UplinkDecoder_Feed(struct UplinkDecoder* decoder, const uint8_t* bytes, size_t length)
+{
+  size_t used = 0;
+  while(used < length && !decoder->Ready)
+  {
+    decoder->Buffer[decoder->Index++] = bytes[used++];
+    _UplinkDecoder_Scan(decoder);
+  }
+  return used;
+}
+
+inline static bool UplinkDecoder_Poll(struct UplinkDecoder* decoder, struct UplinkFrame* out)
+{
+  if(!decoder->Ready)
+  {
+    return false;
+  }
+
+  *out = decoder->Frame;
+  decoder->Ready = false;
+  // bytes left over from a resync may already hold the next frame
+  _UplinkDecoder_Scan(decoder);
+  return true;
+}
+
+#endif
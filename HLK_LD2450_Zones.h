@@ -0,0 +1,357 @@
+#ifndef HLK_LD2450_Zones_h
+#define HLK_LD2450_Zones_h
+
+#include "HLK_LD2450.h"
+
+// Host side zone engine for when the radar's 3 hardware rectangles aren't enough
+// Rectangles and convex polygons are compiled once into edge coefficients plus a uniform
+// grid over their bounds, every cell knows which zones cover it completely (no test needed)
+// and which only touch it (edge tests needed), so classifying a target is one cell lookup
+// and a handful of multiplies no matter how many zones there are
+//
+//   static struct ZoneEngine zones;
+//   ZoneEngine_Init(&zones);
+//   int door = ZoneEngine_AddRectangle(&zones, &doorRegion);
+//   int desk = ZoneEngine_AddPolygon(&zones, deskVertices, 5);
+//   ZoneEngine_Compile(&zones);
+//
+//   struct ZoneOccupancy occupancy;
+//   ZoneEngine_Classify(&zones, &group, &occupancy);
+//   if(occupancy.Occupied & ZONE_BIT(door)) { ... }
+
+// Zones are bits in a uint32_t mask
+#ifndef ZONE_ENGINE_MAX_ZONES
+#if defined(__AVR__)
+#define ZONE_ENGINE_MAX_ZONES 8
+#else
+#define ZONE_ENGINE_MAX_ZONES 32
+#endif
+#endif
+
+#if ZONE_ENGINE_MAX_ZONES > 32
+#error ZONE_ENGINE_MAX_ZONES can not be more than 32
+#endif
+
+// Edges shared by all zones, a rectangle uses 4
+#ifndef ZONE_ENGINE_MAX_EDGES
+#define ZONE_ENGINE_MAX_EDGES (ZONE_ENGINE_MAX_ZONES * 6)
+#endif
+
+// Cells along each axis of the grid
+#ifndef ZONE_ENGINE_GRID_SIZE
+#if defined(__AVR__)
+#define ZONE_ENGINE_GRID_SIZE 8
+#else
+#define ZONE_ENGINE_GRID_SIZE 32
+#endif
+#endif
+
+// Vertices and targets are clamped to +-this many millimeters so edge tests fit in 32 bits,
+// far beyond the radar's 6m range
+#define ZONE_COORDINATE_LIMIT 16383
+
+#define ZONE_BIT(zone) ((uint32_t)1 << (zone))
+
+// Inside when A * x + B * y >= C, |A| and |B| fit in 16 bits and |A * x + B * y| < 2^31
+typedef struct ZoneEdge{
+  int16_t A;
+  int16_t B;
+  int32_t C;
+} ZoneEdge;
+
+typedef struct ZoneBounds{
+  int16_t MinX;
+  int16_t MinY;
+  int16_t MaxX;
+  int16_t MaxY;
+} ZoneBounds;
+
+typedef struct ZoneCell{
+  // Zones that cover the whole cell
+  uint32_t Inside;
+  // Zones that only cover part of it, targets here need the edge tests
+  uint32_t Partial;
+} ZoneCell;
+
+typedef struct ZoneEngine{
+  uint8_t ZoneCount;
+  uint8_t EdgeCount;
+  // Edges of zone i are Edges[FirstEdge[i] .. FirstEdge[i] + EdgeCounts[i])
+  uint8_t FirstEdge[ZONE_ENGINE_MAX_ZONES];
+  uint8_t EdgeCounts[ZONE_ENGINE_MAX_ZONES];
+  struct ZoneBounds Bounds[ZONE_ENGINE_MAX_ZONES];
+  struct ZoneEdge Edges[ZONE_ENGINE_MAX_EDGES];
+
+  // Built by ZoneEngine_Compile
+  bool Compiled;
+  // Everything outside Grid is outside every zone
+  struct ZoneBounds Grid;
+  // Cells are 1 << CellShift millimeters wide
+  uint8_t CellShift;
+  struct ZoneCell Cells[ZONE_ENGINE_GRID_SIZE * ZONE_ENGINE_GRID_SIZE];
+} ZoneEngine;
+
+typedef struct ZoneOccupancy{
+  // Zones each target is in, 0 when the target isn't present
+  uint32_t First;
+  uint32_t Second;
+  uint32_t Third;
+  // Zones with at least one target in them
+  uint32_t Occupied;
+} ZoneOccupancy;
+
+inline static void ZoneEngine_Init(struct ZoneEngine* engine);
+inline static int ZoneEngine_AddPolygon(struct ZoneEngine* engine, const ZoneVertex* vertices, uint8_t count);
+inline static int ZoneEngine_AddRectangle(struct ZoneEngine* engine, const ZoneRegion* region);
+inline static void ZoneEngine_Compile(struct ZoneEngine* engine);
+inline static uint32_t ZoneEngine_Contains(const struct ZoneEngine* engine, int32_t x, int32_t y);
+inline static uint32_t ZoneEngine_ClassifyObject(const struct ZoneEngine* engine, const struct TrackedObject* object);
+inline static void ZoneEngine_Classify(const struct ZoneEngine* engine, const struct TrackedObjectGroup* group, struct ZoneOccupancy* out);
+
+inline static void ZoneEngine_Init(struct ZoneEngine* engine)
+{
+  memset(engine, 0, sizeof(struct ZoneEngine));
+}
+
+inline static int16_t _ZoneClamp(int32_t value)
+{
+  return value < -ZONE_COORDINATE_LIMIT ? -ZONE_COORDINATE_LIMIT : value > ZONE_COORDINATE_LIMIT ? ZONE_COORDINATE_LIMIT : (int16_t)value;
+}
+
+// True when every corner turns the way the polygon winds (area's sign) and the edges go around
+// once, i.e. no concave corner and no star. Straight corners and repeated vertices are fine.
+inline static bool _ZonePolygonConvex(const ZoneVertex* vertices, uint8_t count, int64_t area)
+{
+  uint8_t turns = 0;
+  int previous = 0;
+  for(uint8_t i = 0; i < count; i++)
+  {
+    const ZoneVertex* a = &vertices[i];
+    const ZoneVertex* b = &vertices[(i + 1) % count];
+    const ZoneVertex* c = &vertices[(i + 2) % count];
+    const int32_t abX = _ZoneClamp(b->X) - _ZoneClamp(a->X);
+    const int32_t abY = _ZoneClamp(b->Y) - _ZoneClamp(a->Y);
+    const int32_t bcX = _ZoneClamp(c->X) - _ZoneClamp(b->X);
+    const int32_t bcY = _ZoneClamp(c->Y) - _ZoneClamp(b->Y);
+    const int64_t cross = (int64_t)abX * bcY - (int64_t)abY * bcX;
+    if((area > 0 && cross < 0) || (area < 0 && cross > 0))
+    {
+      return false;
+    }
+
+    // a convex polygon goes left to right once and back once
+    const int direction = abX > 0 ? 1 : abX < 0 ? -1 : 0;
+    if(direction != 0)
+    {
+      turns += previous != 0 && direction != previous;
+      previous = direction;
+    }
+  }
+
+  // the change from the last edge back to the first one wasn't counted
+  int first = 0;
+  for(uint8_t i = 0; i < count && first == 0; i++)
+  {
+    const int32_t dx = _ZoneClamp(vertices[(i + 1) % count].X) - _ZoneClamp(vertices[i].X);
+    first = dx > 0 ? 1 : dx < 0 ? -1 : 0;
+  }
+  turns += first != previous;
+  return turns <= 2;
+}
+
+// Adds a convex polygon, vertices in either winding order
+// returns the zone index (its bit is ZONE_BIT(index)), or -1 if it doesn't fit or isn't convex:
+// an L or any other shape with a corner pointing inwards has to be added as several convex zones
+inline static int ZoneEngine_AddPolygon(struct ZoneEngine* engine, const ZoneVertex* vertices, uint8_t count)
+{
+  if(count < 3 || engine->ZoneCount >= ZONE_ENGINE_MAX_ZONES || engine->EdgeCount + count > ZONE_ENGINE_MAX_EDGES)
+  {
+    return -1;
+  }
+
+  // twice the signed area, negative when the vertices go clockwise
+  int64_t area = 0;
+  for(uint8_t i = 0; i < count; i++)
+  {
+    const ZoneVertex* a = &vertices[i];
+    const ZoneVertex* b = &vertices[(i + 1) % count];
+    area += (int64_t)_ZoneClamp(a->X) * _ZoneClamp(b->Y) - (int64_t)_ZoneClamp(b->X) * _ZoneClamp(a->Y);
+  }
+
+  if(area == 0 || !_ZonePolygonConvex(vertices, count, area))
+  {
+    return -1;
+  }
+
+  const int zone = engine->ZoneCount;
+  struct ZoneBounds* bounds = &engine->Bounds[zone];
+  bounds->MinX = bounds->MinY = ZONE_COORDINATE_LIMIT;
+  bounds->MaxX = bounds->MaxY = -ZONE_COORDINATE_LIMIT;
+
+  engine->FirstEdge[zone] = engine->EdgeCount;
+  engine->EdgeCounts[zone] = count;
+
+  for(uint8_t i = 0; i < count; i++)
+  {
+    const int16_t x1 = _ZoneClamp(vertices[i].X);
+    const int16_t y1 = _ZoneClamp(vertices[i].Y);
+    const int16_t x2 = _ZoneClamp(vertices[(i + 1) % count].X);
+    const int16_t y2 = _ZoneClamp(vertices[(i + 1) % count].Y);
+
+    // normal pointing into the polygon for counter clockwise winding, flipped otherwise
+    struct ZoneEdge* edge = &engine->Edges[engine->EdgeCount++];
+    const int sign = area > 0 ? 1 : -1;
+    edge->A = sign * (y1 - y2);
+    edge->B = sign * (x2 - x1);
+    edge->C = (int32_t)edge->A * x1 + (int32_t)edge->B * y1;
+
+    if(x1 < bounds->MinX) bounds->MinX = x1;
+    if(x1 > bounds->MaxX) bounds->MaxX = x1;
+    if(y1 < bounds->MinY) bounds->MinY = y1;
+    if(y1 > bounds->MaxY) bounds->MaxY = y1;
+  }
+
+  engine->ZoneCount++;
+  engine->Compiled = false;
+  return zone;
+}
+
+// Adds a rectangle given by two opposite corners, same as the radar's own regions
+inline static int ZoneEngine_AddRectangle(struct ZoneEngine* engine, const ZoneRegion* region)
+{
+  const ZoneVertex corners[4] = {
+    { region->Start.X, region->Start.Y },
+    { region->End.X, region->Start.Y },
+    { region->End.X, region->End.Y },
+    { region->Start.X, region->End.Y }
+  };
+  return ZoneEngine_AddPolygon(engine, corners, 4);
+}
+
+inline static bool _ZoneEngine_InsidePolygon(const struct ZoneEngine* engine, uint8_t zone, int32_t x, int32_t y)
+{
+  const struct ZoneEdge* edge = &engine->Edges[engine->FirstEdge[zone]];
+  const struct ZoneEdge* end = edge + engine->EdgeCounts[zone];
+  for(; edge < end; edge++)
+  {
+    if(edge->A * x + edge->B * y < edge->C)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Builds the grid, call after adding zones and before classifying
+inline static void ZoneEngine_Compile(struct ZoneEngine* engine)
+{
+  memset(engine->Cells, 0, sizeof(engine->Cells));
+  engine->Compiled = true;
+
+  if(engine->ZoneCount == 0)
+  {
+    // empty grid, everything is outside
+    engine->Grid.MinX = engine->Grid.MinY = 1;
+    engine->Grid.MaxX = engine->Grid.MaxY = 0;
+    engine->CellShift = 0;
+    return;
+  }
+
+  struct ZoneBounds grid = engine->Bounds[0];
+  for(uint8_t zone = 1; zone < engine->ZoneCount; zone++)
+  {
+    const struct ZoneBounds* bounds = &engine->Bounds[zone];
+    if(bounds->MinX < grid.MinX) grid.MinX = bounds->MinX;
+    if(bounds->MaxX > grid.MaxX) grid.MaxX = bounds->MaxX;
+    if(bounds->MinY < grid.MinY) grid.MinY = bounds->MinY;
+    if(bounds->MaxY > grid.MaxY) grid.MaxY = bounds->MaxY;
+  }
+  engine->Grid = grid;
+
+  // smallest power of two cell that covers the bounds in ZONE_ENGINE_GRID_SIZE cells
+  // so a lookup is a subtract and a shift
+  const int32_t extent = (grid.MaxX - grid.MinX) > (grid.MaxY - grid.MinY) ? (grid.MaxX - grid.MinX) : (grid.MaxY - grid.MinY);
+  uint8_t shift = 0;
+  while((extent >> shift) >= ZONE_ENGINE_GRID_SIZE)
+  {
+    shift++;
+  }
+  engine->CellShift = shift;
+
+  const int32_t cellSize = (int32_t)1 << shift;
+  for(uint8_t row = 0; row < ZONE_ENGINE_GRID_SIZE; row++)
+  {
+    const int32_t minY = grid.MinY + row * cellSize;
+    const int32_t maxY = minY + cellSize - 1;
+    for(uint8_t column = 0; column < ZONE_ENGINE_GRID_SIZE; column++)
+    {
+      const int32_t minX = grid.MinX + column * cellSize;
+      const int32_t maxX = minX + cellSize - 1;
+      struct ZoneCell* cell = &engine->Cells[row * ZONE_ENGINE_GRID_SIZE + column];
+
+      for(uint8_t zone = 0; zone < engine->ZoneCount; zone++)
+      {
+        const struct ZoneBounds* bounds = &engine->Bounds[zone];
+        if(maxX < bounds->MinX || minX > bounds->MaxX || maxY < bounds->MinY || minY > bounds->MaxY)
+        {
+          continue;
+        }
+
+        // a convex zone holding all 4 corners holds the whole cell
+        if(_ZoneEngine_InsidePolygon(engine, zone, minX, minY) && _ZoneEngine_InsidePolygon(engine, zone, maxX, minY) &&
+           _ZoneEngine_InsidePolygon(engine, zone, minX, maxY) && _ZoneEngine_InsidePolygon(engine, zone, maxX, maxY))
+        {
+          cell->Inside |= ZONE_BIT(zone);
+        }
+        else
+        {
+          cell->Partial |= ZONE_BIT(zone);
+        }
+      }
+    }
+  }
+}
+
+// Mask of the zones the point (millimeters) is in
+inline static uint32_t ZoneEngine_Contains(const struct ZoneEngine* engine, int32_t x, int32_t y)
+{
+  x = _ZoneClamp(x);
+  y = _ZoneClamp(y);
+
+  if(x < engine->Grid.MinX || x > engine->Grid.MaxX || y < engine->Grid.MinY || y > engine->Grid.MaxY)
+  {
+    return 0;
+  }
+
+  const uint16_t column = (uint16_t)(x - engine->Grid.MinX) >> engine->CellShift;
+  const uint16_t row = (uint16_t)(y - engine->Grid.MinY) >> engine->CellShift;
+  const struct ZoneCell* cell = &engine->Cells[row * ZONE_ENGINE_GRID_SIZE + column];
+
+  uint32_t result = cell->Inside;
+  for(uint32_t partial = cell->Partial; partial != 0; partial &= partial - 1)
+  {
+    const uint8_t zone = __builtin_ctzl(partial);
+    if(_ZoneEngine_InsidePolygon(engine, zone, x, y))
+    {
+      result |= ZONE_BIT(zone);
+    }
+  }
+
+  return result;
+}
+
+inline static uint32_t ZoneEngine_ClassifyObject(const struct ZoneEngine* engine, const struct TrackedObject* object)
+{
+  return object->Present ? ZoneEngine_Contains(engine, object->X, object->Y) : 0;
+}
+
+// Zones of all 3 targets of a decoded frame
+inline static void ZoneEngine_Classify(const struct ZoneEngine* engine, const struct TrackedObjectGroup* group, struct ZoneOccupancy* out)
+{
+  out->First = ZoneEngine_ClassifyObject(engine, &group->First);
+  out->Second = ZoneEngine_ClassifyObject(engine, &group->Second);
+  out->Third = ZoneEngine_ClassifyObject(engine, &group->Third);
+  out->Occupied = out->First | out->Second | out->Third;
+}
+
+#endif
@@ -0,0 +1,195 @@
+// Cost per time step of HLK_LD2450_Fusion.h with 2, 4 and 8 sensors and how well it removes duplicates
+//
+// People walk around a 10m by 10m room with sensors on its walls facing in. Every sensor sees
+// the people in front of it within its range, at most 3 of them, in its own module coordinates
+// with position noise and missed detections, and delivers its frames at its own phase with some
+// jitter. Every 100ms the frames of all sensors are fused, the timed part is Fusion_Add for every
+// frame that arrived plus Fusion_Step. A person seen by several sensors should come out once.
+// Cycles are read with rdtsc on x86, elsewhere the time in ns is printed instead.
+//
+// g++ -std=gnu++11 -O2 -I ../.. fusion_benchmark.cpp -o fusion_benchmark
+// ./fusion_benchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "HLK_LD2450_Fusion.h"
+
+#define STEPS 100000
+#define STEP_MS 100
+#define PEOPLE 6
+#define ROOM_MM 10000
+#define RANGE_MM 6000
+#define MERGE_MM 400
+
+static uint64_t Ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static const char* TickUnit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return "cycles";
+#else
+  return "ns";
+#endif
+}
+
+static double Noise(double amplitude)
+{
+  return (rand() / (double)RAND_MAX * 2 - 1) * amplitude;
+}
+
+struct Sensor{
+  double X;
+  double Y;
+  double Heading;
+  int Phase_ms;
+};
+
+struct Detection{
+  int Person;
+  double Distance;
+  struct TrackedObject Object;
+};
+
+static void Run(int sensorCount)
+{
+  // evenly around the walls, each facing the middle of the room
+  std::vector<Sensor> sensors(sensorCount);
+  struct Fusion fusion;
+  Fusion_Init(&fusion, MERGE_MM, STEP_MS + 20);
+  for(int s = 0; s < sensorCount; s++)
+  {
+    const double around = 2 * M_PI * s / sensorCount;
+    sensors[s].X = ROOM_MM / 2 - sin(around) * ROOM_MM / 2;
+    sensors[s].Y = ROOM_MM / 2 - cos(around) * ROOM_MM / 2;
+    sensors[s].Heading = -around;
+    sensors[s].Phase_ms = rand() % STEP_MS;
+    Fusion_SetPose(&fusion, s, lround(sensors[s].X), lround(sensors[s].Y), (int16_t)lround(sensors[s].Heading * 1800 / M_PI));
+  }
+
+  double x[PEOPLE], y[PEOPLE], tx[PEOPLE], ty[PEOPLE];
+  for(int p = 0; p < PEOPLE; p++)
+  {
+    x[p] = tx[p] = 1000 + rand() % (ROOM_MM - 2000);
+    y[p] = ty[p] = 1000 + rand() % (ROOM_MM - 2000);
+  }
+
+  std::vector<uint64_t> ticks;
+  ticks.reserve(STEPS);
+  unsigned long seen = 0;
+  unsigned long fused = 0;
+  unsigned long detections = 0;
+
+  for(int step = 0; step < STEPS; step++)
+  {
+    for(int p = 0; p < PEOPLE; p++)
+    {
+      const double dx = tx[p] - x[p];
+      const double dy = ty[p] - y[p];
+      const double left = sqrt(dx * dx + dy * dy);
+      const double walk = 1000.0 * STEP_MS / 1000;
+      if(left < walk)
+      {
+        tx[p] = 1000 + rand() % (ROOM_MM - 2000);
+        ty[p] = 1000 + rand() % (ROOM_MM - 2000);
+      }
+      else
+      {
+        x[p] += dx / left * walk;
+        y[p] += dy / left * walk;
+      }
+    }
+
+    // what each sensor reports in its own coordinates, and which people any sensor reported
+    std::vector<struct TrackedObjectGroup> groups(sensorCount);
+    bool visible[PEOPLE] = {};
+    for(int s = 0; s < sensorCount; s++)
+    {
+      std::vector<Detection> inView;
+      const double c = cos(sensors[s].Heading);
+      const double n = sin(sensors[s].Heading);
+      for(int p = 0; p < PEOPLE; p++)
+      {
+        const double rx = x[p] - sensors[s].X;
+        const double ry = y[p] - sensors[s].Y;
+        const Detection detection = { p, sqrt(rx * rx + ry * ry), {} };
+        const double mx = c * rx + n * ry;
+        const double my = -n * rx + c * ry;
+        // 120 degrees wide, and the radar misses someone now and then
+        if(my <= 0 || detection.Distance > RANGE_MM || fabs(mx) > my * 1.73 || rand() % 20 == 0)
+        {
+          continue;
+        }
+
+        inView.push_back(detection);
+        inView.back().Object.Present = true;
+        inView.back().Object.X = lround(mx + Noise(60));
+        inView.back().Object.Y = lround(my + Noise(60));
+      }
+
+      // the radar only reports 3, the nearest ones here
+      std::sort(inView.begin(), inView.end(), [](const Detection& a, const Detection& b) { return a.Distance < b.Distance; });
+      struct TrackedObject objects[3] = {};
+      for(size_t i = 0; i < inView.size() && i < 3; i++)
+      {
+        objects[i] = inView[i].Object;
+        visible[inView[i].Person] = true;
+        detections++;
+      }
+      groups[s] = { objects[0], objects[1], objects[2] };
+    }
+
+    const unsigned long now = (unsigned long)step * STEP_MS + STEP_MS;
+    struct FusedTarget targets[FUSION_MAX_TARGETS];
+    const uint64_t start = Ticks();
+    for(int s = 0; s < sensorCount; s++)
+    {
+      Fusion_Add(&fusion, s, &groups[s], now - sensors[s].Phase_ms + rand() % 10);
+    }
+    const uint8_t count = Fusion_Step(&fusion, now + 10, targets);
+    ticks.push_back(Ticks() - start);
+
+    for(int p = 0; p < PEOPLE; p++)
+    {
+      seen += visible[p];
+    }
+    fused += count;
+  }
+
+  std::sort(ticks.begin(), ticks.end());
+  uint64_t total = 0;
+  for(uint64_t tick : ticks)
+  {
+    total += tick;
+  }
+  printf("%d sensors  %zu steps  mean %.0f  p50 %llu  p99 %llu  max %llu %s per step, %.0f per sensor\n", sensorCount, ticks.size(), (double)total / ticks.size(),
+    (unsigned long long)ticks[ticks.size() / 2], (unsigned long long)ticks[ticks.size() * 99 / 100], (unsigned long long)ticks.back(), TickUnit(),
+    (double)total / ticks.size() / sensorCount);
+  printf("           %.2f detections, %.2f people reported, %.2f targets out per step\n", (double)detections / STEPS, (double)seen / STEPS, (double)fused / STEPS);
+}
+
+int main()
+{
+  srand(1);
+  const int counts[] = { 2, 4, 8 };
+  for(int count : counts)
+  {
+    Run(count);
+  }
+  return 0;
+}
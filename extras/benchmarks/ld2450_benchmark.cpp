@@ -0,0 +1,552 @@
+// Costs of the core paths of HLK_LD2450.h as one JSON document, to keep next to the commit it
+// was run on and compare from one upgrade to the next:
+//   parse      FrameParser_Feed / Poll over in-memory streams in 1, 30 and 4096 byte reads, and
+//              ReadCommand through a transport that hands out the same bytes
+//   decode     GetTrackedObjectFromBytes per target, DecodeTrackedObjects and GetTrackedObjects per frame
+//   command    SendCommandAndWaitForACK round trips against the emulator (extras/emulator), on the
+//              emulator's clock (the radar link) and on the host's (CPU spent)
+//   startup    InitRadar to the first decoded radar frame for a radar that is running, still
+//              booting, or was left at another rate. InitRadarOnSerial1 is InitRadar on Serial1.
+//   footprint  sizeof of the frame and state types, and the deepest stack of each call, measured
+//              by running it on a painted thread stack. Both are for the host this was built on,
+//              on AVR int and pointers are 16 bits so the types are smaller.
+// Times are the median of 5 rounds. Build with -DHLK_LD2450_STATS to see what the counters cost.
+//
+// g++ -std=gnu++11 -O2 -pthread -I ../.. ld2450_benchmark.cpp -o ld2450_benchmark
+// ./ld2450_benchmark [--quick] [--label NAME] > results.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "extras/emulator/HLK_LD2450_Emulator.h"
+
+#define ROUNDS 5
+#define STACK_PROBE_SIZE (1 << 20)
+
+static double MinRound_s = 0.05;
+static unsigned CommandRounds = 2000;
+static volatile int Sink;
+
+// Hands out a stream of whole radar frames over and over and answers every command right away
+// with a successful ACK, so the library's own cost is all that is measured
+struct MemoryTransport{
+  const uint8_t* Stream = NULL;
+  size_t Length = 0;
+  size_t Offset = 0;
+  uint8_t Reply[MAX_FRAME_SIZE];
+  size_t ReplyLength = 0;
+  size_t ReplyOffset = 0;
+  unsigned long Now_us = 0;
+  struct RadarLink Link = {};
+
+  void Begin(unsigned long) {}
+
+  size_t Available()
+  {
+    return ReplyLength - ReplyOffset + Length - Offset;
+  }
+
+  size_t Read(uint8_t* buffer, size_t length)
+  {
+    // the ACK goes out between two radar frames
+    if(ReplyOffset < ReplyLength && Offset % RADAR_FRAME_SIZE == 0)
+    {
+      const size_t count = std::min(length, ReplyLength - ReplyOffset);
+      memcpy(buffer, Reply + ReplyOffset, count);
+      ReplyOffset += count;
+      return count;
+    }
+
+    size_t count = std::min(length, Length - Offset);
+    if(ReplyOffset < ReplyLength)
+    {
+      count = std::min(count, RADAR_FRAME_SIZE - Offset % RADAR_FRAME_SIZE);
+    }
+    memcpy(buffer, Stream + Offset, count);
+    Offset += count;
+    if(Offset == Length)
+    {
+      Offset = 0;
+    }
+    return count;
+  }
+
+  size_t Write(const uint8_t* buffer, size_t length)
+  {
+    struct Command command;
+    if(ParseFrame(buffer, length, &command) == 0)
+    {
+      return length;
+    }
+
+    // ACK | word 01 | 00 00 status | whatever the command reads, zeros will do
+    // parsed like an ACK, the command word is the first value
+    struct Command ack = {};
+    ack.Word[0] = command.Values[0];
+    ack.Word[1] = 0x01;
+    ack.Size = 2;
+    switch(command.Values[0])
+    {
+      case 0xFF: ack.Size += 4; break;
+      case 0x91: ack.Size += 2; ack.Values[2] = 0x02; break;
+      case 0xA5: ack.Size += 6; break;
+      case 0xC1: ack.Size += ZONE_CONFIGURATION_SIZE; break;
+    }
+    ReplyLength = EncodeCommand(&ack, Reply, sizeof(Reply));
+    ReplyOffset = 0;
+    return length;
+  }
+
+  unsigned long Millis() { return Now_us / 1000; }
+  unsigned long Micros() { return Now_us; }
+  void Delay(unsigned long ms) { Now_us += ms * 1000; }
+};
+
+inline static struct RadarLink* LinkOf(MemoryTransport& port)
+{
+  return &port.Link;
+}
+
+static void MemoryTransport_Open(MemoryTransport* port, const std::vector<uint8_t>& stream)
+{
+  port->Stream = stream.data();
+  port->Length = stream.size();
+  port->Offset = 0;
+  port->ReplyLength = port->ReplyOffset = 0;
+  port->Link = RadarLink{};
+  FrameParser_Init(&port->Link.Parser);
+}
+
+static void AppendRadarFrame(std::vector<uint8_t>& stream, int index)
+{
+  uint8_t frame[RADAR_FRAME_SIZE] = { 0xAA, 0xFF, 0x03, 0x00 };
+  uint8_t* data = frame + RADAR_FRAME_HEADER_SIZE;
+  // one to three people at varying positions, like a busy room
+  for(int target = 0; target <= index % 3; target++)
+  {
+    data = _EncodeInt16(data, _EncodeSignMagnitude(-2000 + (index * 7 + target * 1500) % 4000));
+    data = _EncodeInt16(data, _EncodeSignMagnitude(500 + (index * 3 + target * 900) % 5000));
+    data = _EncodeInt16(data, _EncodeSignMagnitude((index % 41) - 20));
+    data = _EncodeInt16(data, 320);
+  }
+  memcpy(frame + RADAR_FRAME_SIZE - sizeof(RadarEndOfFrame), RadarEndOfFrame, sizeof(RadarEndOfFrame));
+  stream.insert(stream.end(), frame, frame + sizeof(frame));
+}
+
+static void AppendAck(std::vector<uint8_t>& stream)
+{
+  static const uint8_t ack[] = { 0xFD, 0xFC, 0xFB, 0xFA, 0x08, 0x00, 0xFF, 0x01, 0x00, 0x00, 0x01, 0x00, 0x40, 0x00, 0x04, 0x03, 0x02, 0x01 };
+  stream.insert(stream.end(), ack, ack + sizeof(ack));
+}
+
+// radar: back to back radar frames, mixed: an ACK after every 10th, noise: 0 to 8 random bytes between frames
+static std::vector<uint8_t> BuildStream(const char* kind, int frames, size_t* count)
+{
+  std::vector<uint8_t> stream;
+  uint32_t random = 1;
+  *count = 0;
+  for(int i = 0; i < frames; i++)
+  {
+    AppendRadarFrame(stream, i);
+    (*count)++;
+    if(strcmp(kind, "mixed") == 0 && i % 10 == 9)
+    {
+      AppendAck(stream);
+      (*count)++;
+    }
+    if(strcmp(kind, "noise") == 0)
+    {
+      random = random * 1103515245 + 12345;
+      for(uint32_t n = (random >> 16) % 9; n > 0; n--)
+      {
+        random = random * 1103515245 + 12345;
+        stream.push_back(random >> 16);
+      }
+    }
+  }
+  return stream;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Median over ROUNDS rounds of the ns per unit, body returns how many units it did
+template<typename Body>
+static double NsPerUnit(Body body)
+{
+  double rounds[ROUNDS];
+  for(int round = 0; round < ROUNDS; round++)
+  {
+    uint64_t units = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double elapsed;
+    do
+    {
+      units += body();
+      elapsed = Seconds(start);
+    }
+    while(elapsed < MinRound_s);
+    rounds[round] = elapsed * 1e9 / units;
+  }
+  std::sort(rounds, rounds + ROUNDS);
+  return rounds[ROUNDS / 2];
+}
+
+static uint64_t Percentile(std::vector<uint64_t>& values, double fraction)
+{
+  std::sort(values.begin(), values.end());
+  return values.empty() ? 0 : values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static size_t ParseAll(const std::vector<uint8_t>& stream, size_t chunk)
+{
+  struct FrameParser parser;
+  FrameParser_Init(&parser);
+  size_t frames = 0;
+  for(size_t offset = 0; offset < stream.size(); offset += chunk)
+  {
+    const uint8_t* bytes = stream.data() + offset;
+    size_t length = std::min(chunk, stream.size() - offset);
+    while(length > 0)
+    {
+      const size_t used = FrameParser_Feed(&parser, bytes, length);
+      bytes += used;
+      length -= used;
+      struct Command frame;
+      while(FrameParser_Poll(&parser, &frame))
+      {
+        frames++;
+        Sink += frame.Values[0];
+      }
+    }
+  }
+  return frames;
+}
+
+static void RunParse()
+{
+  static const char* kinds[] = { "radar", "mixed", "noise" };
+  static const size_t chunks[] = { 1, 30, 4096 };
+  printf("  \"parse\": [\n");
+  for(size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+  {
+    size_t sent;
+    const std::vector<uint8_t> stream = BuildStream(kinds[k], 10000, &sent);
+    for(size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+    {
+      const size_t frames = ParseAll(stream, chunks[c]);
+      const double ns = NsPerUnit([&]() { ParseAll(stream, chunks[c]); return (uint64_t)stream.size(); });
+      printf("    { \"stream\": \"%s\", \"read_bytes\": %zu, \"bytes\": %zu, \"frames_sent\": %zu, \"frames_out\": %zu, \"mb_per_s\": %.1f, \"ns_per_frame\": %.1f },\n",
+        kinds[k], chunks[c], stream.size(), sent, frames, 1e3 / ns, ns * stream.size() / frames);
+    }
+  }
+
+  // ReadCommand pulls MAX_FRAME_SIZE bytes at a time out of the port into the link's parser
+  size_t sent;
+  const std::vector<uint8_t> stream = BuildStream("radar", 10000, &sent);
+  static MemoryTransport port;
+  MemoryTransport_Open(&port, stream);
+  const double ns = NsPerUnit([&]() {
+    for(int i = 0; i < 1000; i++)
+    {
+      Sink += ReadCommand(port, 0).Values[0];
+    }
+    return (uint64_t)1000;
+  });
+  printf("    { \"stream\": \"radar\", \"read_bytes\": %zu, \"via\": \"ReadCommand\", \"mb_per_s\": %.1f, \"ns_per_frame\": %.1f }\n  ],\n",
+    (size_t)MAX_FRAME_SIZE, RADAR_FRAME_SIZE * 1e3 / ns, ns);
+}
+
+static void RunDecode()
+{
+  size_t sent;
+  const std::vector<uint8_t> stream = BuildStream("radar", 10000, &sent);
+  const size_t frames = stream.size() / RADAR_FRAME_SIZE;
+
+  const double object = NsPerUnit([&]() {
+    for(size_t i = 0; i < frames; i++)
+    {
+      const uint8_t* data = stream.data() + i * RADAR_FRAME_SIZE + RADAR_FRAME_HEADER_SIZE;
+      for(int target = 0; target < 3; target++)
+      {
+        const struct TrackedObject decoded = GetTrackedObjectFromBytes(data + target * TRACKED_OBJECT_SIZE);
+        Sink += decoded.X + decoded.Present;
+      }
+    }
+    return (uint64_t)frames * 3;
+  });
+
+  const double group = NsPerUnit([&]() {
+    for(size_t i = 0; i < frames; i++)
+    {
+      const struct TrackedObjectGroup decoded = DecodeTrackedObjects(stream.data() + i * RADAR_FRAME_SIZE + RADAR_FRAME_HEADER_SIZE);
+      Sink += decoded.First.X + decoded.Second.Y + decoded.Third.Speed;
+    }
+    return (uint64_t)frames;
+  });
+
+  static MemoryTransport port;
+  MemoryTransport_Open(&port, stream);
+  const double read = NsPerUnit([&]() {
+    for(int i = 0; i < 1000; i++)
+    {
+      const struct TrackedObjectGroup decoded = GetTrackedObjects(port);
+      Sink += decoded.First.X + decoded.Second.Y + decoded.Third.Speed;
+    }
+    return (uint64_t)1000;
+  });
+
+  printf("  \"decode\": { \"GetTrackedObjectFromBytes_ns_per_target\": %.2f, \"DecodeTrackedObjects_ns_per_frame\": %.2f, \"GetTrackedObjects_ns_per_frame\": %.1f },\n",
+    object, group, read);
+}
+
+static void RunCommands()
+{
+  static const struct { const char* Name; uint8_t Baud; uint32_t DelayMax_us; } cases[] = {
+    { "256000", b256000, 0 },
+    { "460800", b460800, 0 },
+    { "256000 delay 0-40ms", b256000, 40000 },
+  };
+
+  printf("  \"command\": [\n");
+  for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+  {
+    static struct RadarEmulator radar;
+    RadarEmulator_Init(&radar, 1, 0);
+    radar.Baud = radar.PendingBaud = cases[c].Baud;
+    EmulatorTransport port(&radar);
+    _BeginAt(port, cases[c].Baud);
+    Command_EnableConfigMode(port);
+    radar.Faults.ReplyDelayMax_us = cases[c].DelayMax_us;
+
+    // read tracking mode, the smallest command with an answer
+    struct Command command = {};
+    command.Word[0] = 0x91;
+    std::vector<uint64_t> link_us;
+    std::vector<uint64_t> host_ns;
+    unsigned ok = 0;
+    for(unsigned i = 0; i < CommandRounds; i++)
+    {
+      struct Command response;
+      const uint64_t start_us = port.Now_us;
+      const auto start = std::chrono::steady_clock::now();
+      ok += SendCommandAndWaitForACK(port, &command, &response) == CommandResult_Ok;
+      host_ns.push_back((uint64_t)(Seconds(start) * 1e9));
+      link_us.push_back(port.Now_us - start_us);
+    }
+
+    printf("    { \"case\": \"%s\", \"commands\": %u, \"ok\": %u, \"link_us_p50\": %llu, \"link_us_p99\": %llu, \"host_ns_p50\": %llu, \"host_ns_p99\": %llu }%s\n",
+      cases[c].Name, CommandRounds, ok, (unsigned long long)Percentile(link_us, 0.5), (unsigned long long)Percentile(link_us, 0.99),
+      (unsigned long long)Percentile(host_ns, 0.5), (unsigned long long)Percentile(host_ns, 0.99), c + 1 < sizeof(cases) / sizeof(cases[0]) ? "," : "");
+  }
+  printf("  ],\n");
+}
+
+static void RunStartup()
+{
+  static const struct { const char* Name; uint64_t Boot_us; uint8_t Baud; } cases[] = {
+    { "running", 0, b256000 },
+    { "booting 700ms", 700000, b256000 },
+    { "booting 1200ms", 1200000, b256000 },
+    { "running at 460800", 0, b460800 },
+    { "running at 9600", 0, b9600 },
+  };
+
+  printf("  \"startup\": [\n");
+  for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+  {
+    static struct RadarEmulator radar;
+    RadarEmulator_Init(&radar, 1, cases[c].Boot_us);
+    radar.Baud = radar.PendingBaud = cases[c].Baud;
+    EmulatorTransport port(&radar);
+
+    const auto start = std::chrono::steady_clock::now();
+    struct InitReport report;
+    const bool ready = InitRadar(port, &report);
+    const uint64_t init_us = port.Now_us;
+    bool decoded = false;
+    while(ready && !decoded && port.Now_us < init_us + 1000000)
+    {
+      const struct TrackedObjectGroup group = GetTrackedObjects(port);
+      decoded = group.First.Present;
+    }
+    const double host_us = Seconds(start) * 1e6;
+
+    printf("    { \"radar\": \"%s\", \"ready\": %s, \"baud\": %lu, \"probes\": %u, \"init_ms\": %.1f, \"first_frame_ms\": %.1f, \"host_us\": %.0f }%s\n",
+      cases[c].Name, ready && decoded ? "true" : "false", BaudRateValue(report.BaudRate), report.Probes, init_us / 1e3,
+      port.Now_us / 1e3, host_us, c + 1 < sizeof(cases) / sizeof(cases[0]) ? "," : "");
+  }
+  printf("  ],\n");
+}
+
+struct StackProbe{
+  void (*Run)();
+};
+
+static void* StackProbe_Entry(void* probe)
+{
+  ((struct StackProbe*)probe)->Run();
+  return NULL;
+}
+
+// Bytes of a painted stack that run overwrote, including the thread's own start up
+static size_t StackTouched(void (*run)())
+{
+  void* stack;
+  if(posix_memalign(&stack, 4096, STACK_PROBE_SIZE) != 0)
+  {
+    return 0;
+  }
+  memset(stack, 0xA5, STACK_PROBE_SIZE);
+
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setstack(&attributes, stack, STACK_PROBE_SIZE);
+  struct StackProbe probe = { run };
+  pthread_t thread;
+  size_t untouched = STACK_PROBE_SIZE;
+  if(pthread_create(&thread, &attributes, StackProbe_Entry, &probe) == 0)
+  {
+    pthread_join(thread, NULL);
+    untouched = 0;
+    while(untouched < STACK_PROBE_SIZE && ((const uint8_t*)stack)[untouched] == 0xA5)
+    {
+      untouched++;
+    }
+  }
+  pthread_attr_destroy(&attributes);
+  free(stack);
+  return STACK_PROBE_SIZE - untouched;
+}
+
+// The probes run on another thread, so everything they share lives here
+static std::vector<uint8_t> ProbeStream;
+static MemoryTransport ProbePort;
+
+// The library is header only, whatever a probe calls is inlined into it. The probes stay out of
+// line so each one's frame is what its call needs, measured above the baseline of an empty probe
+#define PROBE __attribute__((noinline)) static void
+
+PROBE Probe_Nothing() {}
+
+PROBE Probe_Parse()
+{
+  Sink += ParseAll(ProbeStream, 4096);
+}
+
+// Inlined into the probe the decode fits in registers and measured 0, out of line it needs room for its result
+__attribute__((noinline)) static struct TrackedObjectGroup Decode_OutOfLine(const uint8_t* data)
+{
+  return DecodeTrackedObjects(data);
+}
+
+PROBE Probe_Decode()
+{
+  const struct TrackedObjectGroup group = Decode_OutOfLine(ProbeStream.data() + RADAR_FRAME_HEADER_SIZE);
+  Sink += group.First.X;
+}
+
+PROBE Probe_ReadCommand()
+{
+  Sink += ReadCommand(ProbePort, 0).Values[0];
+}
+
+PROBE Probe_GetTrackedObjects()
+{
+  Sink += GetTrackedObjects(ProbePort).First.X;
+}
+
+PROBE Probe_SendCommandAndWaitForACK()
+{
+  struct Command command = {};
+  command.Word[0] = 0x91;
+  struct Command response;
+  Sink += SendCommandAndWaitForACK(ProbePort, &command, &response);
+}
+
+PROBE Probe_GetZoneConfiguration()
+{
+  Sink += Command_GetZoneConfiguration(ProbePort).Type;
+}
+
+PROBE Probe_InitRadar()
+{
+  Sink += InitRadar(ProbePort);
+}
+
+static void RunFootprint()
+{
+  printf("  \"footprint\": {\n    \"sizeof\": {");
+  printf(" \"Command\": %zu, \"FrameParser\": %zu, \"RadarLink\": %zu, \"TrackedObject\": %zu, \"TrackedObjectGroup\": %zu,",
+    sizeof(struct Command), sizeof(struct FrameParser), sizeof(struct RadarLink), sizeof(struct TrackedObject), sizeof(struct TrackedObjectGroup));
+  printf(" \"ZoneConfiguration\": %zu, \"MacAddress\": %zu, \"InitReport\": %zu, \"CommandPolicy\": %zu, \"EventLog\": %zu,",
+    sizeof(ZoneConfiguration), sizeof(MacAddress), sizeof(struct InitReport), sizeof(struct CommandPolicy), sizeof(struct EventLog));
+  printf(" \"LD2450_over_transport\": %zu, \"largest_command_frame\": %zu },\n",
+    sizeof(LD2450<MemoryTransport>) - sizeof(MemoryTransport), (size_t)MAX_FRAME_SIZE);
+
+  size_t sent;
+  ProbeStream = BuildStream("mixed", 100, &sent);
+  static const struct { const char* Name; void (*Run)(); } probes[] = {
+    { "FrameParser_Feed_Poll", Probe_Parse },
+    { "DecodeTrackedObjects", Probe_Decode },
+    { "ReadCommand", Probe_ReadCommand },
+    { "GetTrackedObjects", Probe_GetTrackedObjects },
+    { "SendCommandAndWaitForACK", Probe_SendCommandAndWaitForACK },
+    { "Command_GetZoneConfiguration", Probe_GetZoneConfiguration },
+    { "InitRadar", Probe_InitRadar },
+  };
+
+  const size_t baseline = StackTouched(Probe_Nothing);
+  printf("    \"stack_bytes\": {");
+  for(size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); p++)
+  {
+    size_t radar;
+    static std::vector<uint8_t> stream;
+    stream = BuildStream("radar", 100, &radar);
+    MemoryTransport_Open(&ProbePort, stream);
+    const size_t touched = StackTouched(probes[p].Run);
+    printf(" \"%s\": %zu%s", probes[p].Name, touched > baseline ? touched - baseline : 0, p + 1 < sizeof(probes) / sizeof(probes[0]) ? "," : "");
+  }
+  printf(" }\n  }\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* label = "";
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--quick") == 0)
+    {
+      MinRound_s = 0.005;
+      CommandRounds = 200;
+    }
+    else if(strcmp(argv[i], "--label") == 0 && i + 1 < argc) label = argv[++i];
+    else
+    {
+      fprintf(stderr, "usage: %s [--quick] [--label NAME]\n", argv[0]);
+      return 1;
+    }
+  }
+
+#if defined(HLK_LD2450_STATS)
+  const bool stats = true;
+#else
+  const bool stats = false;
+#endif
+  printf("{\n  \"suite\": \"ld2450\",\n  \"label\": \"%s\",\n  \"compiler\": \"%s\",\n  \"stats\": %s,\n  \"int_bits\": %zu,\n  \"pointer_bits\": %zu,\n",
+    label, __VERSION__, stats ? "true" : "false", sizeof(int) * 8, sizeof(void*) * 8);
+  RunParse();
+  RunDecode();
+  RunCommands();
+  RunStartup();
+  RunFootprint();
+  printf("}\n");
+  return Sink == 0x7FFFFFFF;
+}
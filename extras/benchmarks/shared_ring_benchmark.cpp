@@ -0,0 +1,144 @@
+// Throughput of HLK_LD2450_SharedRing.h: one publisher process writing decoded frames as fast
+// as it can (or at a fixed rate) and several reader processes following it, each reports frames
+// read and lost. Unpaced on fewer cores than processes the publisher laps the readers whenever
+// they are descheduled, pace it to see the loss free rate.
+//
+// g++ -std=gnu++11 -O2 -I ../.. shared_ring_benchmark.cpp -o shared_ring_benchmark -lrt
+// ./shared_ring_benchmark [readers] [frames] [frames per second, 0 is unpaced]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <chrono>
+
+#include "HLK_LD2450_SharedRing.h"
+
+#define RING_NAME "/ld2450_benchmark"
+#define RING_SLOTS 4096
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int RunReader(int id, uint64_t frames, int ready)
+{
+  struct SharedRing ring;
+  if(!SharedRing_Open(&ring, RING_NAME))
+  {
+    perror("SharedRing_Open");
+    return 1;
+  }
+
+  struct SharedRingReader reader;
+  SharedRingReader_Init(&reader, &ring, false);
+
+  // tell the publisher this reader is attached
+  const char byte = 1;
+  if(write(ready, &byte, 1) != 1)
+  {
+    return 1;
+  }
+  close(ready);
+
+  uint64_t read = 0;
+  uint64_t checksum = 0;
+  uint64_t empty = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while(reader.Next < frames)
+  {
+    struct SharedTargetFrame frame;
+    const SharedRingReadResult result = SharedRingReader_Read(&reader, &frame);
+    if(result == SharedRingRead_Ok)
+    {
+      read++;
+      checksum += frame.Targets[0].X;
+      continue;
+    }
+    if(result == SharedRingRead_Empty)
+    {
+      // give the publisher the core on small machines
+      empty++;
+      sched_yield();
+    }
+  }
+  const double elapsed = Seconds(start);
+
+  printf("reader %d  %.2f Mframes/s  read %llu  lost %llu  empty polls %llu  checksum %llu\n", id, read / elapsed / 1e6,
+    (unsigned long long)read, (unsigned long long)reader.Lost, (unsigned long long)empty, (unsigned long long)checksum);
+  SharedRing_Close(&ring);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  const int readers = argc > 1 ? atoi(argv[1]) : 3;
+  const uint64_t frames = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000ULL;
+  const double rate = argc > 3 ? atof(argv[3]) : 0;
+
+  struct SharedRing ring;
+  if(!SharedRing_Create(&ring, RING_NAME, RING_SLOTS))
+  {
+    perror("SharedRing_Create");
+    return 1;
+  }
+
+  int ready[2];
+  if(pipe(ready) != 0)
+  {
+    return 1;
+  }
+
+  for(int i = 0; i < readers; i++)
+  {
+    if(fork() == 0)
+    {
+      close(ready[0]);
+      return RunReader(i, frames, ready[1]);
+    }
+  }
+  close(ready[1]);
+
+  for(int i = 0; i < readers; i++)
+  {
+    char byte;
+    if(read(ready[0], &byte, 1) != 1)
+    {
+      return 1;
+    }
+  }
+
+  struct TrackedObjectGroup group = {};
+  group.First.Present = true;
+  group.First.Y = 1500;
+
+  const auto start = std::chrono::steady_clock::now();
+  for(uint64_t i = 0; i < frames; i++)
+  {
+    group.First.X = i & 0x3FF;
+    SharedRing_PublishGroup(&ring, i & 3, i, &group);
+
+    if(rate > 0 && (i & 1023) == 1023)
+    {
+      const double ahead = (i + 1) / rate - Seconds(start);
+      if(ahead > 0)
+      {
+        usleep(ahead * 1e6);
+      }
+    }
+  }
+  const double elapsed = Seconds(start);
+  printf("publisher  %.2f Mframes/s  %llu frames  %zu byte slots  %d readers\n", frames / elapsed / 1e6,
+    (unsigned long long)frames, sizeof(struct SharedRingSlot), readers);
+  fflush(stdout);
+
+  for(int i = 0; i < readers; i++)
+  {
+    wait(NULL);
+  }
+
+  SharedRing_Close(&ring);
+  shm_unlink(RING_NAME);
+  return 0;
+}
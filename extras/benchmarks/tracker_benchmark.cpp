@@ -0,0 +1,255 @@
+// Cost per frame of HLK_LD2450_Tracker.h and how well it keeps ids
+//
+// Without arguments three people walk around a room, the frames get position noise, missed
+// detections and their slots shuffled the way the radar does, and every id change of a person
+// is counted. Given a capture (HLK_LD2450_Capture.h, e.g. from ld2450d --record) the radar
+// frames in it are replayed through the tracker instead, per sensor.
+// Cycles are read with rdtsc on x86, elsewhere the time in ns is printed instead.
+//
+// g++ -std=gnu++11 -O2 -I ../.. tracker_benchmark.cpp -o tracker_benchmark
+// ./tracker_benchmark [capture.ld2450]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "HLK_LD2450_Capture.h"
+#include "HLK_LD2450_Tracker.h"
+
+#define FRAMES 200000
+#define FRAME_MS 100
+#define PEOPLE 3
+
+static uint64_t Ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static const char* TickUnit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return "cycles";
+#else
+  return "ns";
+#endif
+}
+
+struct Timed{
+  unsigned long Time_ms;
+  struct TrackedObjectGroup Group;
+};
+
+static void Report(const char* name, std::vector<uint64_t>& ticks)
+{
+  std::sort(ticks.begin(), ticks.end());
+  uint64_t total = 0;
+  for(uint64_t tick : ticks)
+  {
+    total += tick;
+  }
+  printf("%s  %zu frames  mean %.0f  p50 %llu  p99 %llu  max %llu %s per frame\n", name, ticks.size(), (double)total / ticks.size(),
+    (unsigned long long)ticks[ticks.size() / 2], (unsigned long long)ticks[ticks.size() * 99 / 100], (unsigned long long)ticks.back(), TickUnit());
+}
+
+static double Noise(double amplitude)
+{
+  return (rand() / (double)RAND_MAX * 2 - 1) * amplitude;
+}
+
+static int RunSynthetic()
+{
+  // each person walks between random waypoints at 0.5 to 1.5 m/s
+  double x[PEOPLE], y[PEOPLE], tx[PEOPLE], ty[PEOPLE], speed[PEOPLE];
+  uint16_t lastId[PEOPLE] = {};
+  for(int p = 0; p < PEOPLE; p++)
+  {
+    x[p] = tx[p] = -2000 + p * 2000;
+    y[p] = ty[p] = 1500 + p * 1000;
+    speed[p] = 1000;
+  }
+
+  struct Tracker tracker;
+  Tracker_Init(&tracker, NULL);
+  std::vector<uint64_t> ticks;
+  ticks.reserve(FRAMES);
+  unsigned long switches = 0;
+  unsigned long matched = 0;
+
+  for(int frame = 0; frame < FRAMES; frame++)
+  {
+    struct TrackedObject objects[3] = {};
+    // the radar doesn't keep people in the same slot
+    int order[3] = { 0, 1, 2 };
+    for(int i = 2; i > 0; i--)
+    {
+      std::swap(order[i], order[rand() % (i + 1)]);
+    }
+
+    for(int p = 0; p < PEOPLE; p++)
+    {
+      const double dx = tx[p] - x[p];
+      const double dy = ty[p] - y[p];
+      const double left = sqrt(dx * dx + dy * dy);
+      const double step = speed[p] * FRAME_MS / 1000;
+      if(left < step)
+      {
+        tx[p] = Noise(3000);
+        ty[p] = 500 + rand() % 5000;
+        speed[p] = 500 + rand() % 1000;
+      }
+      else
+      {
+        x[p] += dx / left * step;
+        y[p] += dy / left * step;
+      }
+
+      // the radar misses someone now and then
+      if(rand() % 20 == 0)
+      {
+        continue;
+      }
+
+      struct TrackedObject* object = &objects[order[p]];
+      object->Present = true;
+      object->X = x[p] + Noise(60);
+      object->Y = y[p] + Noise(60);
+    }
+
+    const struct TrackedObjectGroup group = { objects[0], objects[1], objects[2] };
+    struct TrackedTarget targets[TRACKER_MAX_TRACKS];
+    const uint64_t start = Ticks();
+    const uint8_t count = Tracker_Update(&tracker, &group, (unsigned long)frame * FRAME_MS, targets);
+    ticks.push_back(Ticks() - start);
+
+    // the nearest target to each person is who the tracker thinks it is
+    for(int p = 0; p < PEOPLE; p++)
+    {
+      int best = -1;
+      double bestDistance = 500 * 500;
+      for(int t = 0; t < count; t++)
+      {
+        const double dx = targets[t].X - x[p];
+        const double dy = targets[t].Y - y[p];
+        if(dx * dx + dy * dy < bestDistance)
+        {
+          bestDistance = dx * dx + dy * dy;
+          best = t;
+        }
+      }
+
+      if(best < 0)
+      {
+        continue;
+      }
+      matched++;
+      if(lastId[p] != 0 && lastId[p] != targets[best].Id)
+      {
+        switches++;
+      }
+      lastId[p] = targets[best].Id;
+    }
+  }
+
+  Report("synthetic", ticks);
+  printf("%lu id switches in %lu person frames, %u ids handed out\n", switches, matched, tracker.NextId - 1);
+  return 0;
+}
+
+static int RunCapture(const char* path)
+{
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if(fd < 0 || fstat(fd, &info) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+
+  const uint8_t* data = (const uint8_t*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  struct CaptureReader reader;
+  if(data == MAP_FAILED || !CaptureReader_Open(&reader, data, info.st_size))
+  {
+    fprintf(stderr, "%s is not a capture\n", path);
+    return 1;
+  }
+
+  // decode everything first so only the tracker is timed
+  static struct FrameParser parsers[256];
+  static std::vector<Timed> frames[256];
+  for(int sensor = 0; sensor < 256; sensor++)
+  {
+    FrameParser_Init(&parsers[sensor]);
+  }
+
+  struct CaptureRecord record;
+  while(CaptureReader_Next(&reader, &record))
+  {
+    const uint8_t* bytes = record.Bytes;
+    size_t length = record.Length;
+    while(length > 0)
+    {
+      const size_t used = FrameParser_Feed(&parsers[record.Sensor], bytes, length);
+      bytes += used;
+      length -= used;
+
+      struct Command frame;
+      if(FrameParser_Poll(&parsers[record.Sensor], &frame) && frame.Word[0] == 0xAA)
+      {
+        const Timed timed = { (unsigned long)(record.Timestamp_us / 1000), DecodeTrackedObjects(frame.Values) };
+        frames[record.Sensor].push_back(timed);
+      }
+    }
+  }
+
+  std::vector<uint64_t> ticks;
+  for(int sensor = 0; sensor < 256; sensor++)
+  {
+    if(frames[sensor].empty())
+    {
+      continue;
+    }
+
+    struct Tracker tracker;
+    Tracker_Init(&tracker, NULL);
+    for(const Timed& timed : frames[sensor])
+    {
+      struct TrackedTarget targets[TRACKER_MAX_TRACKS];
+      const uint64_t start = Ticks();
+      Tracker_Update(&tracker, &timed.Group, timed.Time_ms, targets);
+      ticks.push_back(Ticks() - start);
+    }
+    printf("sensor %d  %zu frames  %u ids handed out\n", sensor, frames[sensor].size(), tracker.NextId - 1);
+  }
+
+  munmap((void*)data, info.st_size);
+  if(ticks.empty())
+  {
+    fprintf(stderr, "%s has no radar frames\n", path);
+    return 1;
+  }
+
+  Report(path, ticks);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  srand(1);
+  return argc > 1 ? RunCapture(argv[1]) : RunSynthetic();
+}
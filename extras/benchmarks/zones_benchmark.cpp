@@ -0,0 +1,121 @@
+// Time per frame of the zone engine against the number of zones, next to testing every zone
+// polygon by polygon, for a room sized field of random rectangles and hexagons
+//
+// g++ -std=gnu++11 -O2 -I ../.. zones_benchmark.cpp -o zones_benchmark && ./zones_benchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "HLK_LD2450_Zones.h"
+
+#define FRAMES 4096
+#define ROUNDS 64
+
+static int Random(int min, int max)
+{
+  return min + rand() % (max - min + 1);
+}
+
+static void AddRandomZone(struct ZoneEngine* engine, int index)
+{
+  const int x = Random(-3000, 2500);
+  const int y = Random(0, 5500);
+
+  if(index % 2 == 0)
+  {
+    const ZoneRegion region = { { x, y }, { x + Random(200, 1500), y + Random(200, 1500) } };
+    ZoneEngine_AddRectangle(engine, &region);
+    return;
+  }
+
+  const int r = Random(200, 800);
+  const ZoneVertex hexagon[6] = {
+    { x + r, y }, { x + r / 2, y + r }, { x - r / 2, y + r },
+    { x - r, y }, { x - r / 2, y - r }, { x + r / 2, y - r }
+  };
+  ZoneEngine_AddPolygon(engine, hexagon, 6);
+}
+
+// What the grid saves, every edge of every zone for every target
+static uint32_t ClassifyBruteForce(const struct ZoneEngine* engine, const struct TrackedObject* object)
+{
+  uint32_t result = 0;
+  for(uint8_t zone = 0; zone < engine->ZoneCount; zone++)
+  {
+    if(object->Present && _ZoneEngine_InsidePolygon(engine, zone, object->X, object->Y))
+    {
+      result |= ZONE_BIT(zone);
+    }
+  }
+  return result;
+}
+
+int main()
+{
+  static struct TrackedObjectGroup frames[FRAMES];
+  for(int i = 0; i < FRAMES; i++)
+  {
+    struct TrackedObject* objects[3] = { &frames[i].First, &frames[i].Second, &frames[i].Third };
+    for(int j = 0; j < 3; j++)
+    {
+      objects[j]->X = Random(-3500, 3500);
+      objects[j]->Y = Random(0, 6000);
+      objects[j]->Present = Random(0, 3) != 0;
+    }
+  }
+
+  printf("zones  grid ns/frame  brute force ns/frame\n");
+
+  for(int zones = 1; zones <= ZONE_ENGINE_MAX_ZONES; zones *= 2)
+  {
+    static struct ZoneEngine engine;
+    srand(zones);
+    ZoneEngine_Init(&engine);
+    for(int i = 0; i < zones; i++)
+    {
+      AddRandomZone(&engine, i);
+    }
+    ZoneEngine_Compile(&engine);
+
+    volatile uint32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int round = 0; round < ROUNDS; round++)
+    {
+      for(int i = 0; i < FRAMES; i++)
+      {
+        struct ZoneOccupancy occupancy;
+        ZoneEngine_Classify(&engine, &frames[i], &occupancy);
+        sink = sink + occupancy.Occupied;
+      }
+    }
+    const double grid = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (ROUNDS * FRAMES);
+
+    uint32_t mismatches = 0;
+    start = std::chrono::steady_clock::now();
+    for(int round = 0; round < ROUNDS; round++)
+    {
+      for(int i = 0; i < FRAMES; i++)
+      {
+        const uint32_t occupied = ClassifyBruteForce(&engine, &frames[i].First) |
+          ClassifyBruteForce(&engine, &frames[i].Second) | ClassifyBruteForce(&engine, &frames[i].Third);
+        sink = sink + occupied;
+      }
+    }
+    const double brute = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (ROUNDS * FRAMES);
+
+    for(int i = 0; i < FRAMES; i++)
+    {
+      struct ZoneOccupancy occupancy;
+      ZoneEngine_Classify(&engine, &frames[i], &occupancy);
+      mismatches += occupancy.First != ClassifyBruteForce(&engine, &frames[i].First);
+      mismatches += occupancy.Second != ClassifyBruteForce(&engine, &frames[i].Second);
+      mismatches += occupancy.Third != ClassifyBruteForce(&engine, &frames[i].Third);
+    }
+
+    printf("%5d  %14.1f  %20.1f%s\n", zones, grid, brute, mismatches ? "  MISMATCH" : "");
+  }
+
+  return 0;
+}
@@ -0,0 +1,632 @@
+#ifndef HLK_LD2450_Emulator_h
+#define HLK_LD2450_Emulator_h
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "HLK_LD2450.h"
+
+// Software LD2450 for host tests, benchmarks and stress runs, no hardware needed
+// The emulator keeps the module's settings, streams AA FF 03 00 frames every FrameInterval_us
+// and answers the FD FC FB FA commands with the module's ACK layouts:
+//   FF enable configuration mode    ACK | 01 00 protocol version | 40 00 buffer size, radar frames stop
+//   FE disable configuration mode   ACK, radar frames resume
+//   80 / 90 single / multi target   ACK
+//   91 read tracking mode           ACK | 01 00 single or 02 00 multi
+//   A0 firmware version             ACK | 00 00 type | major u16 | minor u32
+//   A1 baud rate, A2 factory reset, A4 bluetooth, all applied by the next restart
+//   A3 restart                      ACK, then silent for Restart_us and back at the new rate
+//   A5 MAC address                  ACK | 6 bytes
+//   C1 / C2 read / write zones      ACK | 26 bytes, see ZONE_CONFIGURATION_SIZE
+// Commands other than FF and FE outside configuration mode, unknown words and bad values are NACKed.
+//
+// Time is whatever the caller says it is, so the same emulator runs on a virtual clock in
+// memory (EmulatorTransport below) or in real time behind a pty (ld2450_emulator.cpp).
+// Every byte leaves at the line rate, 10 bits per byte, after the bytes queued before it.
+// Faults are drawn from a seeded generator so a run can be repeated exactly:
+//   DropPpm, FlipPpm          bytes lost / bytes with a flipped bit, per million bytes sent
+//   AckMidFramePpm            ACKs that land in the middle of a radar frame, which the module starts sending just before
+//   NoReplyPpm                commands that are never answered
+//   ReplyDelayMin_us/Max_us   time from the end of a command to its ACK
+// When the host's baud rate is not the module's, whatever it reads is noise and whatever it
+// writes is lost, the way a real UART at the wrong rate behaves.
+
+#define EMULATOR_PROTOCOL_VERSION 0x0001
+#define EMULATOR_BUFFER_SIZE 0x0040
+
+typedef struct EmulatorFaults{
+  uint32_t DropPpm;
+  uint32_t FlipPpm;
+  uint32_t AckMidFramePpm;
+  uint32_t NoReplyPpm;
+  uint32_t ReplyDelayMin_us;
+  uint32_t ReplyDelayMax_us;
+} EmulatorFaults;
+
+typedef struct EmulatorStats{
+  uint64_t RadarFrames;
+  uint64_t Acks;
+  uint64_t Commands;
+  uint64_t BytesSent;
+  uint64_t BytesDropped;
+  uint64_t BitsFlipped;
+  uint64_t AcksMidFrame;
+  uint64_t RepliesDropped;
+  // Bytes written by the host at the wrong baud rate or while the module restarts
+  uint64_t BytesLost;
+} EmulatorStats;
+
+typedef struct EmulatorByte{
+  uint64_t At_us;
+  uint8_t Byte;
+  // The rate it was sent at, a restart changes it for the bytes after
+  uint8_t Baud;
+  // Part of a radar frame and where in it, an ACK mid frame goes in before one past the start
+  bool Radar;
+  uint8_t Offset;
+} EmulatorByte;
+
+typedef struct EmulatorReply{
+  uint64_t At_us;
+  std::vector<uint8_t> Bytes;
+  bool Restart;
+  bool MidFrame;
+} EmulatorReply;
+
+typedef struct RadarEmulator{
+  // Settings as the module keeps them, Pending* take effect at the next restart
+  uint8_t Baud;
+  uint8_t PendingBaud;
+  uint8_t TrackingMode;
+  bool Bluetooth;
+  bool PendingBluetooth;
+  bool PendingFactoryReset;
+  bool ConfigMode;
+  uint8_t Mac[6];
+  uint8_t Zones[ZONE_CONFIGURATION_SIZE];
+
+  uint32_t FrameInterval_us;
+  uint32_t Restart_us;
+  struct EmulatorFaults Faults;
+  // What the next radar frames carry, Present false sends all zeros for that target
+  // With Walk set the first target walks 1m/s back and forth between X -2000 and 2000
+  struct TrackedObject Targets[3];
+  bool Walk;
+
+  // Nothing is sent before this, while booting or restarting
+  uint64_t Silent_us;
+  uint64_t NextFrame_us;
+  // When the last queued byte has left
+  uint64_t LineFree_us;
+  uint64_t Now_us;
+  std::deque<struct EmulatorByte> Out;
+  std::vector<struct EmulatorReply> Replies;
+  struct FrameParser Commands;
+  uint32_t Random;
+  struct EmulatorStats Stats;
+} RadarEmulator;
+
+inline static void RadarEmulator_Init(struct RadarEmulator* radar, uint32_t seed = 1, uint64_t boot_us = 0);
+inline static void RadarEmulator_Advance(struct RadarEmulator* radar, uint64_t now_us);
+inline static void RadarEmulator_Receive(struct RadarEmulator* radar, const uint8_t* bytes, size_t length, unsigned long hostBaud, uint64_t now_us);
+inline static size_t RadarEmulator_Take(struct RadarEmulator* radar, uint8_t* buffer, size_t length, unsigned long hostBaud, uint64_t now_us);
+inline static size_t RadarEmulator_Ready(struct RadarEmulator* radar, uint64_t now_us);
+inline static uint64_t RadarEmulator_NextEvent(const struct RadarEmulator* radar);
+inline static void RadarEmulator_Frame(const struct RadarEmulator* radar, uint8_t* frame);
+
+inline static void _RadarEmulator_Defaults(struct RadarEmulator* radar)
+{
+  radar->Baud = DEFAULT_RADAR_BAUD_RATE;
+  radar->PendingBaud = DEFAULT_RADAR_BAUD_RATE;
+  radar->TrackingMode = 2;
+  radar->Bluetooth = true;
+  radar->PendingBluetooth = true;
+  radar->PendingFactoryReset = false;
+  memset(radar->Zones, 0, sizeof(radar->Zones));
+}
+
+// boot_us is when the module starts sending, like the time a real one takes after power on
+inline static void RadarEmulator_Init(struct RadarEmulator* radar, uint32_t seed, uint64_t boot_us)
+{
+  _RadarEmulator_Defaults(radar);
+  radar->ConfigMode = false;
+  const uint8_t mac[6] = { 0x8F, 0x27, 0x2E, 0xB8, 0x0F, 0x65 };
+  memcpy(radar->Mac, mac, sizeof(mac));
+
+  radar->FrameInterval_us = 100000;
+  radar->Restart_us = 1000000;
+  radar->Faults = EmulatorFaults{};
+  memset(radar->Targets, 0, sizeof(radar->Targets));
+  radar->Targets[0].Present = true;
+  radar->Targets[0].X = -782;
+  radar->Targets[0].Y = 1713;
+  radar->Targets[0].Speed = -100;
+  radar->Targets[0].DistanceResolution = 320;
+  radar->Walk = true;
+
+  radar->Silent_us = boot_us;
+  radar->NextFrame_us = boot_us;
+  radar->LineFree_us = 0;
+  radar->Now_us = 0;
+  radar->Out.clear();
+  radar->Replies.clear();
+  FrameParser_Init(&radar->Commands);
+  radar->Random = seed != 0 ? seed : 1;
+  radar->Stats = EmulatorStats{};
+}
+
+// xorshift32, deterministic per seed
+inline static uint32_t _RadarEmulator_Random(struct RadarEmulator* radar)
+{
+  uint32_t x = radar->Random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return radar->Random = x;
+}
+
+inline static bool _RadarEmulator_Chance(struct RadarEmulator* radar, uint32_t ppm)
+{
+  return ppm != 0 && _RadarEmulator_Random(radar) % 1000000 < ppm;
+}
+
+inline static uint32_t _RadarEmulator_ByteTime_us(uint8_t baud)
+{
+  // 8N1 is 10 bits a byte
+  return (uint32_t)((10000000UL + BaudRateValue(baud) - 1) / BaudRateValue(baud));
+}
+
+inline static uint16_t _EncodeSignMagnitude(int value)
+{
+  return value >= 0 ? (uint16_t)(0x8000 | value) : (uint16_t)(-value);
+}
+
+// Where the walking target is at at_us, 1mm per ms so 8 seconds there and back
+inline static void _RadarEmulator_Walk(struct RadarEmulator* radar, uint64_t at_us)
+{
+  if(!radar->Walk)
+  {
+    return;
+  }
+
+  struct TrackedObject* target = &radar->Targets[0];
+  const int phase = (int)(at_us / 1000 % 8000);
+  target->X = phase < 4000 ? -2000 + phase : 6000 - phase;
+  target->Speed = phase < 4000 ? 100 : -100;
+}
+
+// The 30 bytes of the next radar frame
+inline static void RadarEmulator_Frame(const struct RadarEmulator* radar, uint8_t* frame)
+{
+  memcpy(frame, RadarHeader, sizeof(RadarHeader));
+  uint8_t* at = frame + RADAR_FRAME_HEADER_SIZE;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    const struct TrackedObject* target = &radar->Targets[i];
+    if(!target->Present)
+    {
+      memset(at, 0, TRACKED_OBJECT_SIZE);
+      at += TRACKED_OBJECT_SIZE;
+      continue;
+    }
+
+    at = _EncodeInt16(at, _EncodeSignMagnitude(target->X));
+    at = _EncodeInt16(at, _EncodeSignMagnitude(target->Y));
+    at = _EncodeInt16(at, _EncodeSignMagnitude(target->Speed));
+    at = _EncodeInt16(at, target->DistanceResolution);
+  }
+  memcpy(at, RadarEndOfFrame, sizeof(RadarEndOfFrame));
+}
+
+// Queues bytes on the line, with faults, from at_us or when the line is free
+// midFrame puts them into the radar frame on the wire at at_us instead of after it
+inline static void _RadarEmulator_Send(struct RadarEmulator* radar, const uint8_t* bytes, size_t length, uint64_t at_us, bool isRadar, bool midFrame = false)
+{
+  const uint32_t byteTime = _RadarEmulator_ByteTime_us(radar->Baud);
+  std::deque<struct EmulatorByte>::iterator insert = radar->Out.end();
+  uint64_t time = at_us > radar->LineFree_us ? at_us : radar->LineFree_us;
+
+  if(midFrame)
+  {
+    for(std::deque<struct EmulatorByte>::iterator at = radar->Out.begin(); at != radar->Out.end(); ++at)
+    {
+      if(at->Radar && at->Offset > 0 && at->At_us > at_us)
+      {
+        insert = at;
+        time = at->At_us - byteTime;
+        radar->Stats.AcksMidFrame++;
+        break;
+      }
+    }
+  }
+  const uint64_t start = time;
+
+  std::vector<struct EmulatorByte> sent;
+  sent.reserve(length);
+  for(size_t i = 0; i < length; i++)
+  {
+    time += byteTime;
+    radar->Stats.BytesSent++;
+    if(_RadarEmulator_Chance(radar, radar->Faults.DropPpm))
+    {
+      radar->Stats.BytesDropped++;
+      continue;
+    }
+
+    struct EmulatorByte byte = { time, bytes[i], radar->Baud, isRadar, (uint8_t)i };
+    if(_RadarEmulator_Chance(radar, radar->Faults.FlipPpm))
+    {
+      byte.Byte ^= 1 << (_RadarEmulator_Random(radar) & 7);
+      radar->Stats.BitsFlipped++;
+    }
+    sent.push_back(byte);
+  }
+
+  // whatever was behind a spliced ACK goes out after it
+  for(std::deque<struct EmulatorByte>::iterator after = insert; after != radar->Out.end(); ++after)
+  {
+    after->At_us += time - start;
+  }
+  radar->Out.insert(insert, sent.begin(), sent.end());
+  if(radar->Out.empty() || radar->Out.back().At_us < time)
+  {
+    radar->LineFree_us = time;
+  }
+  else
+  {
+    radar->LineFree_us = radar->Out.back().At_us;
+  }
+}
+
+inline static void _RadarEmulator_Ack(struct RadarEmulator* radar, uint8_t word, bool ok, const uint8_t* data, size_t length, uint64_t at_us, bool restart = false)
+{
+  if(_RadarEmulator_Chance(radar, radar->Faults.NoReplyPpm))
+  {
+    radar->Stats.RepliesDropped++;
+    return;
+  }
+
+  struct EmulatorReply reply;
+  reply.Restart = restart;
+  reply.At_us = at_us + radar->Faults.ReplyDelayMin_us;
+  if(radar->Faults.ReplyDelayMax_us > radar->Faults.ReplyDelayMin_us)
+  {
+    reply.At_us += _RadarEmulator_Random(radar) % (radar->Faults.ReplyDelayMax_us - radar->Faults.ReplyDelayMin_us + 1);
+  }
+  // the module works through its commands one at a time, a reply never overtakes an earlier one
+  if(!radar->Replies.empty() && radar->Replies.back().At_us > reply.At_us)
+  {
+    reply.At_us = radar->Replies.back().At_us;
+  }
+
+  // as if the module had started a radar frame just before, the ACK lands 1 to 28 bytes into it
+  reply.MidFrame = _RadarEmulator_Chance(radar, radar->Faults.AckMidFramePpm);
+  if(reply.MidFrame)
+  {
+    const uint32_t byteTime = _RadarEmulator_ByteTime_us(radar->Baud);
+    const uint64_t into = byteTime * (1 + _RadarEmulator_Random(radar) % (RADAR_FRAME_SIZE - 2));
+    uint64_t start = reply.At_us > into ? reply.At_us - into : 0;
+    start = start > radar->LineFree_us ? start : radar->LineFree_us;
+    start = start > at_us ? start : at_us;
+    reply.At_us = start + into;
+
+    uint8_t frame[RADAR_FRAME_SIZE];
+    _RadarEmulator_Walk(radar, start);
+    RadarEmulator_Frame(radar, frame);
+    _RadarEmulator_Send(radar, frame, sizeof(frame), start, true);
+    radar->Stats.RadarFrames++;
+  }
+
+  const uint8_t size = (uint8_t)(4 + length);
+  const uint8_t header[] = { size, 0x00, word, 0x01, (uint8_t)(ok ? 0x00 : 0x01), 0x00 };
+  reply.Bytes.insert(reply.Bytes.end(), ACKHeader, ACKHeader + sizeof(ACKHeader));
+  reply.Bytes.insert(reply.Bytes.end(), header, header + sizeof(header));
+  reply.Bytes.insert(reply.Bytes.end(), data, data + length);
+  reply.Bytes.insert(reply.Bytes.end(), ACKEndOfFrame, ACKEndOfFrame + sizeof(ACKEndOfFrame));
+
+  radar->Replies.push_back(reply);
+}
+
+inline static void _RadarEmulator_Command(struct RadarEmulator* radar, const struct Command* command, uint64_t at_us)
+{
+  const uint8_t word = command->Values[0];
+  const uint8_t* values = command->Values + 2;
+  const uint8_t count = command->Size >= 2 ? command->Size - 2 : 0;
+  const uint16_t value = count >= 2 ? (uint16_t)(values[0] | (values[1] << 8)) : 0;
+  radar->Stats.Commands++;
+
+  if(!radar->ConfigMode && word != 0xFF && word != 0xFE)
+  {
+    _RadarEmulator_Ack(radar, word, false, NULL, 0, at_us);
+    return;
+  }
+
+  switch(word)
+  {
+    case 0xFF:
+    {
+      const uint8_t data[] = { EMULATOR_PROTOCOL_VERSION & 0xFF, EMULATOR_PROTOCOL_VERSION >> 8, EMULATOR_BUFFER_SIZE & 0xFF, EMULATOR_BUFFER_SIZE >> 8 };
+      radar->ConfigMode = radar->ConfigMode || value == 0x0001;
+      _RadarEmulator_Ack(radar, word, value == 0x0001, data, sizeof(data), at_us);
+      return;
+    }
+    case 0xFE:
+      radar->ConfigMode = false;
+      // reporting picks up from now, not with a burst for the time it was quiet
+      radar->NextFrame_us = at_us + radar->FrameInterval_us;
+      _RadarEmulator_Ack(radar, word, true, NULL, 0, at_us);
+      return;
+    case 0x80:
+    case 0x90:
+      radar->TrackingMode = word == 0x80 ? 1 : 2;
+      _RadarEmulator_Ack(radar, word, true, NULL, 0, at_us);
+      return;
+    case 0x91:
+    {
+      const uint8_t data[] = { radar->TrackingMode, 0x00 };
+      _RadarEmulator_Ack(radar, word, true, data, sizeof(data), at_us);
+      return;
+    }
+    case 0xA0:
+    {
+      const uint8_t data[] = { 0x00, 0x00, 0x02, 0x01, 0x16, 0x24, 0x06, 0x22 };
+      _RadarEmulator_Ack(radar, word, true, data, sizeof(data), at_us);
+      return;
+    }
+    case 0xA1:
+    {
+      const bool ok = BaudRateValue((uint8_t)value) != 0 && value <= 0xFF;
+      if(ok)
+      {
+        radar->PendingBaud = (uint8_t)value;
+      }
+      _RadarEmulator_Ack(radar, word, ok, NULL, 0, at_us);
+      return;
+    }
+    case 0xA2:
+      radar->PendingFactoryReset = true;
+      _RadarEmulator_Ack(radar, word, true, NULL, 0, at_us);
+      return;
+    case 0xA3:
+      _RadarEmulator_Ack(radar, word, true, NULL, 0, at_us, true);
+      return;
+    case 0xA4:
+      if(value <= 1)
+      {
+        radar->PendingBluetooth = value == 1;
+      }
+      _RadarEmulator_Ack(radar, word, value <= 1, NULL, 0, at_us);
+      return;
+    case 0xA5:
+      _RadarEmulator_Ack(radar, word, value == 0x0001, radar->Mac, sizeof(radar->Mac), at_us);
+      return;
+    case 0xC1:
+      _RadarEmulator_Ack(radar, word, true, radar->Zones, sizeof(radar->Zones), at_us);
+      return;
+    case 0xC2:
+      if(count == ZONE_CONFIGURATION_SIZE && values[0] <= 2)
+      {
+        memcpy(radar->Zones, values, ZONE_CONFIGURATION_SIZE);
+        _RadarEmulator_Ack(radar, word, true, NULL, 0, at_us);
+        return;
+      }
+      _RadarEmulator_Ack(radar, word, false, NULL, 0, at_us);
+      return;
+    default:
+      _RadarEmulator_Ack(radar, word, false, NULL, 0, at_us);
+      return;
+  }
+}
+
+// Comes back from A3 with whatever was pending applied
+inline static void _RadarEmulator_Restart(struct RadarEmulator* radar, uint64_t at_us)
+{
+  if(radar->PendingFactoryReset)
+  {
+    _RadarEmulator_Defaults(radar);
+  }
+  radar->Baud = radar->PendingBaud;
+  radar->Bluetooth = radar->PendingBluetooth;
+  radar->ConfigMode = false;
+  radar->Replies.clear();
+  FrameParser_Init(&radar->Commands);
+  radar->Silent_us = at_us + radar->Restart_us;
+  radar->NextFrame_us = radar->Silent_us;
+}
+
+inline static void _RadarEmulator_NextFrame(struct RadarEmulator* radar)
+{
+  uint8_t frame[RADAR_FRAME_SIZE];
+  _RadarEmulator_Walk(radar, radar->NextFrame_us);
+  RadarEmulator_Frame(radar, frame);
+  _RadarEmulator_Send(radar, frame, sizeof(frame), radar->NextFrame_us, true);
+  radar->Stats.RadarFrames++;
+  radar->NextFrame_us += radar->FrameInterval_us;
+}
+
+// Sends every radar frame and reply due by now_us
+inline static void RadarEmulator_Advance(struct RadarEmulator* radar, uint64_t now_us)
+{
+  radar->Now_us = now_us;
+  while(true)
+  {
+    const bool streaming = !radar->ConfigMode;
+    const uint64_t frame_us = radar->NextFrame_us > radar->Silent_us ? radar->NextFrame_us : radar->Silent_us;
+    const bool replyDue = !radar->Replies.empty() && radar->Replies.front().At_us <= now_us;
+    const bool frameDue = streaming && frame_us <= now_us;
+
+    if(replyDue && (!frameDue || radar->Replies.front().At_us <= frame_us))
+    {
+      struct EmulatorReply reply = radar->Replies.front();
+      radar->Replies.erase(radar->Replies.begin());
+      _RadarEmulator_Send(radar, reply.Bytes.data(), reply.Bytes.size(), reply.At_us, false, reply.MidFrame);
+      radar->Stats.Acks++;
+      if(reply.Restart)
+      {
+        _RadarEmulator_Restart(radar, radar->LineFree_us);
+      }
+      continue;
+    }
+
+    if(frameDue)
+    {
+      radar->NextFrame_us = frame_us;
+      _RadarEmulator_NextFrame(radar);
+      continue;
+    }
+
+    return;
+  }
+}
+
+// Bytes the host wrote, each command is answered ReplyDelay after it ended
+inline static void RadarEmulator_Receive(struct RadarEmulator* radar, const uint8_t* bytes, size_t length, unsigned long hostBaud, uint64_t now_us)
+{
+  RadarEmulator_Advance(radar, now_us);
+  if(hostBaud != BaudRateValue(radar->Baud) || now_us < radar->Silent_us)
+  {
+    radar->Stats.BytesLost += length;
+    return;
+  }
+
+  while(length > 0)
+  {
+    const size_t used = FrameParser_Feed(&radar->Commands, bytes, length);
+    bytes += used;
+    length -= used;
+
+    struct Command command;
+    if(FrameParser_Poll(&radar->Commands, &command) && command.Word[0] == ACKHeader[0] && command.Size >= 2)
+    {
+      _RadarEmulator_Command(radar, &command, now_us);
+    }
+  }
+}
+
+// How many bytes have arrived by now_us
+inline static size_t RadarEmulator_Ready(struct RadarEmulator* radar, uint64_t now_us)
+{
+  RadarEmulator_Advance(radar, now_us);
+  size_t count = 0;
+  for(std::deque<struct EmulatorByte>::const_iterator at = radar->Out.begin(); at != radar->Out.end() && at->At_us <= now_us; ++at)
+  {
+    count++;
+  }
+  return count;
+}
+
+// When the next byte arrives, or the next frame or reply is due if nothing is on the line
+inline static uint64_t RadarEmulator_NextEvent(const struct RadarEmulator* radar)
+{
+  if(!radar->Out.empty())
+  {
+    return radar->Out.front().At_us;
+  }
+
+  uint64_t next = (uint64_t)-1;
+  if(!radar->ConfigMode)
+  {
+    next = radar->NextFrame_us > radar->Silent_us ? radar->NextFrame_us : radar->Silent_us;
+  }
+  if(!radar->Replies.empty() && radar->Replies.front().At_us < next)
+  {
+    next = radar->Replies.front().At_us;
+  }
+  return next;
+}
+
+// Hands out bytes that have arrived by now_us, noise when hostBaud is not the module's rate
+inline static size_t RadarEmulator_Take(struct RadarEmulator* radar, uint8_t* buffer, size_t length, unsigned long hostBaud, uint64_t now_us)
+{
+  RadarEmulator_Advance(radar, now_us);
+  size_t count = 0;
+  while(count < length && !radar->Out.empty() && radar->Out.front().At_us <= now_us)
+  {
+    const struct EmulatorByte* byte = &radar->Out.front();
+    buffer[count++] = hostBaud == BaudRateValue(byte->Baud) ? byte->Byte : (uint8_t)_RadarEmulator_Random(radar);
+    radar->Out.pop_front();
+  }
+  return count;
+}
+
+// In memory transport on a virtual clock, pass it to any function that takes a port:
+//   RadarEmulator radar;
+//   RadarEmulator_Init(&radar);
+//   EmulatorTransport port(&radar);
+//   InitRadar(port);
+//   Command_EnableConfigMode(port);
+// Polling with nothing to read moves the clock to the next byte, at most IdleStep_us, so
+// timeouts expire and a second of radar runs in well under a millisecond.
+struct EmulatorTransport{
+  struct RadarEmulator* Radar;
+  struct RadarLink Link = {};
+  unsigned long Baud = 256000;
+  uint64_t Now_us = 0;
+  uint32_t IdleStep_us = 1000;
+
+  explicit EmulatorTransport(struct RadarEmulator* radar) : Radar(radar) {}
+
+  void Begin(unsigned long baud)
+  {
+    Baud = baud;
+  }
+
+  // Nothing to read, as if the host waited for the next byte
+  void Idle()
+  {
+    const uint64_t next = RadarEmulator_NextEvent(Radar);
+    const uint64_t limit = Now_us + IdleStep_us;
+    Now_us = next > Now_us && next < limit ? next : limit;
+  }
+
+  size_t Available()
+  {
+    const size_t ready = RadarEmulator_Ready(Radar, Now_us);
+    if(ready == 0)
+    {
+      Idle();
+    }
+    return ready;
+  }
+
+  size_t Read(uint8_t* buffer, size_t length)
+  {
+    const size_t count = RadarEmulator_Take(Radar, buffer, length, Baud, Now_us);
+    if(count == 0)
+    {
+      Idle();
+    }
+    return count;
+  }
+
+  size_t Write(const uint8_t* buffer, size_t length)
+  {
+    // the command has to cross the line before the module sees it
+    Now_us += (uint64_t)length * 10000000ULL / Baud;
+    RadarEmulator_Receive(Radar, buffer, length, Baud, Now_us);
+    return length;
+  }
+
+  unsigned long Millis()
+  {
+    return (unsigned long)(Now_us / 1000);
+  }
+
+  unsigned long Micros()
+  {
+    return (unsigned long)Now_us;
+  }
+
+  void Delay(unsigned long ms)
+  {
+    Now_us += (uint64_t)ms * 1000;
+  }
+};
+
+inline static struct RadarLink* LinkOf(EmulatorTransport& port)
+{
+  return &port.Link;
+}
+
+#endif
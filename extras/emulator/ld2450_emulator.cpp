@@ -0,0 +1,172 @@
+// Runs an emulated LD2450 (HLK_LD2450_Emulator.h) behind a pty, in real time
+//
+//   ld2450_emulator [--rate HZ] [--baud N] [--seed N] [--link PATH] [--any-baud]
+//                   [--drop PPM] [--flip PPM] [--mid-frame PPM] [--no-reply PPM] [--delay MIN_US:MAX_US]
+//     prints the pty to open, e.g. ld2450d /dev/pts/3 or any program using PosixTransport
+//     --baud is the module's starting rate (256000), the program on the pty has to set the same
+//     rate unless --any-baud is given, e.g. for cat or hexdump
+//     --link makes a symlink to the pty, the fault options are per million as in the header
+//   Ctrl-C prints what was sent and which faults were injected.
+//
+// g++ -std=gnu++11 -O2 -I ../.. ld2450_emulator.cpp -o ld2450_emulator
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+
+#include "HLK_LD2450_Posix.h"
+#include "HLK_LD2450_Emulator.h"
+
+static volatile sig_atomic_t Running = 1;
+
+static void Stop(int)
+{
+  Running = 0;
+}
+
+static uint64_t NowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+// A pty master reports the termios of its slave, so this is what the program on the other end set
+static unsigned long HostBaud(int master)
+{
+  struct termios2 options;
+  if(ioctl(master, TCGETS2, &options) != 0)
+  {
+    return 0;
+  }
+  return options.c_ospeed;
+}
+
+static uint8_t BaudRateIndex(unsigned long baud)
+{
+  for(uint8_t index = b9600; index <= b460800; index++)
+  {
+    if(BaudRateValue(index) == baud)
+    {
+      return index;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  static struct RadarEmulator radar;
+  unsigned rate_hz = 10;
+  unsigned long baud = 256000;
+  uint32_t seed = 1;
+  bool anyBaud = false;
+  const char* link = NULL;
+  struct EmulatorFaults faults = {};
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rate_hz = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--baud") == 0 && i + 1 < argc) baud = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--link") == 0 && i + 1 < argc) link = argv[++i];
+    else if(strcmp(argv[i], "--any-baud") == 0) anyBaud = true;
+    else if(strcmp(argv[i], "--drop") == 0 && i + 1 < argc) faults.DropPpm = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--flip") == 0 && i + 1 < argc) faults.FlipPpm = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--mid-frame") == 0 && i + 1 < argc) faults.AckMidFramePpm = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--no-reply") == 0 && i + 1 < argc) faults.NoReplyPpm = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--delay") == 0 && i + 1 < argc && sscanf(argv[++i], "%u:%u", &faults.ReplyDelayMin_us, &faults.ReplyDelayMax_us) == 2) {}
+    else
+    {
+      fprintf(stderr, "usage: %s [--rate HZ] [--baud N] [--seed N] [--link PATH] [--any-baud]\n"
+        "          [--drop PPM] [--flip PPM] [--mid-frame PPM] [--no-reply PPM] [--delay MIN_US:MAX_US]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if(rate_hz == 0 || BaudRateIndex(baud) == 0)
+  {
+    fprintf(stderr, "the rate has to be above 0 and the baud rate one the module supports\n");
+    return 1;
+  }
+
+  const int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    perror("pty");
+    return 1;
+  }
+  const char* slave = ptsname(master);
+  if(link != NULL && (unlink(link), symlink(slave, link) != 0))
+  {
+    perror(link);
+    return 1;
+  }
+
+  // keeps the pty open while nothing else has it, raw so the frames aren't echoed back as commands
+  PosixTransport hold;
+  if(!hold.Open(slave, baud))
+  {
+    perror(slave);
+    return 1;
+  }
+
+  RadarEmulator_Init(&radar, seed, 0);
+  radar.Baud = radar.PendingBaud = BaudRateIndex(baud);
+  radar.FrameInterval_us = 1000000 / rate_hz;
+  radar.Faults = faults;
+  printf("%s\n", slave);
+  fflush(stdout);
+
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+  const uint64_t start = NowMicros();
+  uint64_t unread = 0;
+  uint8_t buffer[4096];
+
+  while(Running)
+  {
+    const uint64_t now = NowMicros() - start;
+    const unsigned long host = anyBaud ? BaudRateValue(radar.Baud) : HostBaud(master);
+
+    ssize_t count;
+    while((count = read(master, buffer, sizeof(buffer))) > 0)
+    {
+      RadarEmulator_Receive(&radar, buffer, count, host, now);
+    }
+
+    size_t ready;
+    while((ready = RadarEmulator_Take(&radar, buffer, sizeof(buffer), host, now)) > 0)
+    {
+      // nobody reading fills the pty, the radar doesn't wait either
+      if(write(master, buffer, ready) != (ssize_t)ready)
+      {
+        unread += ready;
+      }
+    }
+
+    const uint64_t next = RadarEmulator_NextEvent(&radar);
+    const uint64_t wait = next > now ? (next - now < 100000 ? next - now : 100000) : 0;
+    const struct timespec timeout = { (time_t)(wait / 1000000), (long)(wait % 1000000) * 1000 };
+    struct pollfd input = { master, POLLIN, 0 };
+    ppoll(&input, 1, &timeout, NULL);
+  }
+
+  const struct EmulatorStats* stats = &radar.Stats;
+  fprintf(stderr, "%llu radar frames  %llu acks  %llu commands  %llu bytes  %llu dropped  %llu flipped  %llu acks mid frame  %llu replies withheld  %llu bytes at the wrong rate  %llu unread\n",
+    (unsigned long long)stats->RadarFrames, (unsigned long long)stats->Acks, (unsigned long long)stats->Commands,
+    (unsigned long long)stats->BytesSent, (unsigned long long)stats->BytesDropped, (unsigned long long)stats->BitsFlipped,
+    (unsigned long long)stats->AcksMidFrame, (unsigned long long)stats->RepliesDropped, (unsigned long long)stats->BytesLost,
+    (unsigned long long)unread);
+
+  if(link != NULL)
+  {
+    unlink(link);
+  }
+  hold.Close();
+  close(master);
+  return 0;
+}
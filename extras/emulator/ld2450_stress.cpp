@@ -0,0 +1,257 @@
+// Parser throughput and recovery, and command reliability, against the emulator under faults
+//
+//   ld2450_stress [--seconds S] [--cycles N] [--seed N]
+//
+// parse: the emulator streams back to back frames at 460800 baud for S seconds of virtual time
+// (60 by default) while the host toggles configuration mode now and then so ACKs are mixed in.
+// The bytes are collected in memory, then fed through a FrameParser in 4KB reads. Reported are
+// the parse rate, how many of the frames sent came out, frames lost per injected fault, and
+// radar frames that came out with damaged targets, which the protocol has no checksum to catch.
+//
+// commands: N cycles (500 by default) of enable configuration mode, read tracking mode, MAC,
+// zones and disable through EmulatorTransport, reading a frame in between. Reported are the
+// cycles where every command came back right, the result counts, and the time per command on
+// the emulator's clock (what the radar link would take) and on the host's (CPU spent).
+//
+// g++ -std=gnu++11 -O2 -I ../.. ld2450_stress.cpp -o ld2450_stress
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "HLK_LD2450_Emulator.h"
+
+struct Profile{
+  const char* Name;
+  struct EmulatorFaults Faults;
+};
+
+static const Profile ParseProfiles[] = {
+  { "clean", { 0, 0, 0, 0, 0, 0 } },
+  { "drop 1000ppm", { 1000, 0, 0, 0, 0, 0 } },
+  { "flip 1000ppm", { 0, 1000, 0, 0, 0, 0 } },
+  { "ack mid frame", { 0, 0, 1000000, 0, 0, 0 } },
+  { "drop+flip 5000ppm", { 5000, 5000, 0, 0, 0, 0 } },
+  { "all of it", { 2000, 2000, 500000, 0, 0, 0 } },
+};
+
+static const Profile CommandProfiles[] = {
+  { "clean", { 0, 0, 0, 0, 0, 0 } },
+  { "delay 0-40ms", { 0, 0, 0, 0, 0, 40000 } },
+  { "delay 30-80ms", { 0, 0, 0, 0, 30000, 80000 } },
+  { "no reply 10%", { 0, 0, 0, 100000, 0, 0 } },
+  { "ack mid frame", { 0, 0, 1000000, 0, 0, 0 } },
+  { "drop+flip 1000ppm", { 1000, 1000, 0, 0, 0, 0 } },
+  { "all of it", { 1000, 1000, 300000, 50000, 0, 60000 } },
+};
+
+static double NowSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// What the emulator's walking target looks like, anything else was damaged on the way
+static bool Plausible(const struct TrackedObjectGroup* group)
+{
+  const struct TrackedObject* first = &group->First;
+  return first->Present && first->Y == 1713 && first->DistanceResolution == 320 && (first->Speed == 100 || first->Speed == -100) &&
+    first->X >= -2000 && first->X <= 2000 && !group->Second.Present && !group->Third.Present;
+}
+
+static void RunParse(const Profile* profile, unsigned seconds, uint32_t seed)
+{
+  static struct RadarEmulator radar;
+  RadarEmulator_Init(&radar, seed, 0);
+  radar.Baud = radar.PendingBaud = b460800;
+  // a frame takes 651us at 460800, so the line is nearly always busy
+  radar.FrameInterval_us = 700;
+  radar.Faults = profile->Faults;
+
+  // the host side, on the emulator's clock
+  std::vector<uint8_t> stream;
+  uint8_t buffer[4096];
+  bool config = false;
+  for(uint64_t now = 0; now < (uint64_t)seconds * 1000000; now += 1000)
+  {
+    // a command every 50ms, configuration mode on for one of them, off for the next
+    if(now % 50000 == 0 && now > 0)
+    {
+      if(config)
+      {
+        RadarEmulator_Receive(&radar, DisableConfigModeFrame::Bytes, sizeof(DisableConfigModeFrame::Bytes), 460800, now);
+      }
+      else
+      {
+        RadarEmulator_Receive(&radar, EnableConfigModeFrame::Bytes, sizeof(EnableConfigModeFrame::Bytes), 460800, now);
+      }
+      config = !config;
+    }
+
+    size_t count;
+    while((count = RadarEmulator_Take(&radar, buffer, sizeof(buffer), 460800, now)) > 0)
+    {
+      stream.insert(stream.end(), buffer, buffer + count);
+    }
+  }
+
+  const uint64_t sent = radar.Stats.RadarFrames + radar.Stats.Acks;
+  const uint64_t faults = radar.Stats.BytesDropped + radar.Stats.BitsFlipped + radar.Stats.AcksMidFrame;
+  uint64_t frames = 0;
+  uint64_t damaged = 0;
+  double elapsed = 0;
+  int rounds = 0;
+
+  // repeat till the timing means something, counting only the first round
+  while(elapsed < 0.5)
+  {
+    struct FrameParser parser;
+    FrameParser_Init(&parser);
+    uint64_t found = 0;
+    uint64_t bad = 0;
+    const double start = NowSeconds();
+    for(size_t offset = 0; offset < stream.size(); offset += sizeof(buffer))
+    {
+      const uint8_t* bytes = stream.data() + offset;
+      size_t length = std::min(sizeof(buffer), stream.size() - offset);
+      while(length > 0)
+      {
+        const size_t used = FrameParser_Feed(&parser, bytes, length);
+        bytes += used;
+        length -= used;
+
+        struct Command frame;
+        while(FrameParser_Poll(&parser, &frame))
+        {
+          found++;
+          if(frame.Word[0] == 0xAA)
+          {
+            const struct TrackedObjectGroup group = DecodeTrackedObjects(frame.Values);
+            bad += !Plausible(&group);
+          }
+        }
+      }
+    }
+    elapsed += NowSeconds() - start;
+    if(rounds++ == 0)
+    {
+      frames = found;
+      damaged = bad;
+    }
+  }
+
+  const uint64_t lost = sent > frames ? sent - frames : 0;
+  printf("%-18s  %8.0f  %8llu  %7.3f%%  %8llu  %9.2f  %8llu\n", profile->Name, stream.size() * rounds / elapsed / 1e6,
+    (unsigned long long)sent, 100.0 * frames / sent, (unsigned long long)faults, faults > 0 ? (double)lost / faults : 0.0,
+    (unsigned long long)damaged);
+}
+
+static uint64_t Percentile(std::vector<uint64_t>& values, double fraction)
+{
+  if(values.empty())
+  {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static void RunCommands(const Profile* profile, unsigned cycles, uint32_t seed)
+{
+  static struct RadarEmulator radar;
+  RadarEmulator_Init(&radar, seed, 0);
+  radar.Faults = profile->Faults;
+  EmulatorTransport port(&radar);
+  InitRadar(port);
+
+  const uint8_t mac[6] = { 0x8F, 0x27, 0x2E, 0xB8, 0x0F, 0x65 };
+  unsigned results[4] = {};
+  unsigned good = 0;
+  std::vector<uint64_t> link_us;
+  std::vector<uint64_t> host_ns;
+
+  for(unsigned cycle = 0; cycle < cycles; cycle++)
+  {
+    GetTrackedObjects(port);
+    bool right = true;
+    for(int step = 0; step < 5; step++)
+    {
+      const uint64_t start_us = port.Now_us;
+      const double start = NowSeconds();
+      CommandResult result = CommandResult_Ok;
+      switch(step)
+      {
+        case 0:
+          result = Command_EnableConfigMode(port);
+          break;
+        case 1:
+          result = Command_ReadTrackingMode(port) == 2 ? CommandResult_Ok : CommandResult_Timeout;
+          break;
+        case 2:
+        {
+          const MacAddress read = Command_GetMacAddress(port);
+          result = memcmp(read.Bytes, mac, sizeof(mac)) == 0 ? CommandResult_Ok : CommandResult_Timeout;
+          break;
+        }
+        case 3:
+        {
+          // a failed read is all zeros, the same as the emulator's zones, so check the raw ACK
+          struct Command response;
+          result = SendFrameAndWaitForACK<GetZoneConfigurationFrame>(port, &response);
+          if(result == CommandResult_Ok && response.Size != 4 + ZONE_CONFIGURATION_SIZE)
+          {
+            result = CommandResult_Desync;
+          }
+          break;
+        }
+        case 4:
+          result = Command_DisableConfigMode(port);
+          break;
+      }
+      host_ns.push_back((uint64_t)((NowSeconds() - start) * 1e9));
+      link_us.push_back(port.Now_us - start_us);
+      results[result < 4 ? result : 3]++;
+      right = right && result == CommandResult_Ok;
+    }
+    good += right;
+  }
+
+  printf("%-18s  %6.1f%%  %6u  %6u  %7u  %6u  %7llu  %7llu  %8llu\n", profile->Name, 100.0 * good / cycles,
+    results[CommandResult_Ok], results[CommandResult_Nack], results[CommandResult_Timeout], results[CommandResult_Desync],
+    (unsigned long long)Percentile(link_us, 0.5), (unsigned long long)Percentile(link_us, 0.99), (unsigned long long)Percentile(host_ns, 0.5));
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seconds = 60;
+  unsigned cycles = 500;
+  uint32_t seed = 1;
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) cycles = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+    else
+    {
+      fprintf(stderr, "usage: %s [--seconds S] [--cycles N] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("parse               MB/s      frames   out       faults    lost/fault  damaged\n");
+  for(const Profile& profile : ParseProfiles)
+  {
+    RunParse(&profile, seconds, seed);
+  }
+
+  printf("\ncommands            cycles   ok      nack    timeout  desync  p50_us   p99_us   host_ns\n");
+  for(const Profile& profile : CommandProfiles)
+  {
+    RunCommands(&profile, cycles, seed);
+  }
+  return 0;
+}
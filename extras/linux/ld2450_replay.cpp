@@ -0,0 +1,180 @@
+// Replays a capture (HLK_LD2450_Capture.h) through the frame parser and target decoder
+//
+//   ld2450_replay [--realtime] [--from SECONDS] [--repeat N] [--print] capture.ld2450
+//     as fast as possible by default, which is how decoder throughput is measured,
+//     --realtime keeps the recorded spacing between reads instead
+//     --print writes "sensor time_us x y speed x y speed x y speed" for every radar frame
+//
+// Captures are written by ld2450d --record or by CaptureRecorder in your own program.
+//
+// g++ -std=gnu++11 -O2 -I ../.. ld2450_replay.cpp -o ld2450_replay
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "HLK_LD2450_Capture.h"
+
+static unsigned long long NowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+struct ReplayStats{
+  unsigned long long Records = 0;
+  unsigned long long Bytes = 0;
+  unsigned long long RadarFrames = 0;
+  unsigned long long AckFrames = 0;
+  unsigned long long Targets = 0;
+};
+
+int main(int argc, char** argv)
+{
+  bool realtime = false;
+  bool print = false;
+  double from = 0;
+  int repeat = 1;
+  const char* path = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--realtime") == 0) realtime = true;
+    else if(strcmp(argv[i], "--print") == 0) print = true;
+    else if(strcmp(argv[i], "--from") == 0 && i + 1 < argc) from = atof(argv[++i]);
+    else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+    else path = argv[i];
+  }
+
+  if(path == NULL)
+  {
+    fprintf(stderr, "usage: %s [--realtime] [--from SECONDS] [--repeat N] [--print] capture\n", argv[0]);
+    return 1;
+  }
+
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if(fd < 0 || fstat(fd, &info) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+
+  const uint8_t* data = (const uint8_t*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void*)data, info.st_size, MADV_SEQUENTIAL);
+
+  struct CaptureReader reader;
+  if(!CaptureReader_Open(&reader, data, info.st_size))
+  {
+    fprintf(stderr, "%s is not a capture\n", path);
+    return 1;
+  }
+
+  // the first record's time is the start of the capture
+  struct CaptureRecord record;
+  if(!CaptureReader_Next(&reader, &record))
+  {
+    fprintf(stderr, "%s is empty\n", path);
+    return 0;
+  }
+  const uint64_t first_us = record.Timestamp_us;
+
+  // one parser per sensor, reads of different sensors are interleaved in the file
+  static struct FrameParser parsers[256];
+  struct ReplayStats stats;
+  const unsigned long long start = NowMicros();
+
+  for(int round = 0; round < repeat; round++)
+  {
+    for(int sensor = 0; sensor < 256; sensor++)
+    {
+      FrameParser_Init(&parsers[sensor]);
+    }
+
+    CaptureReader_Seek(&reader, first_us + (uint64_t)(from * 1e6));
+    const unsigned long long roundStart = NowMicros();
+    uint64_t roundFirst_us = 0;
+    bool started = false;
+
+    while(CaptureReader_Next(&reader, &record))
+    {
+      if(record.Timestamp_us < first_us + (uint64_t)(from * 1e6))
+      {
+        continue;
+      }
+
+      if(!started)
+      {
+        roundFirst_us = record.Timestamp_us;
+        started = true;
+      }
+
+      if(realtime)
+      {
+        const unsigned long long due = roundStart + (record.Timestamp_us - roundFirst_us);
+        const unsigned long long now = NowMicros();
+        if(due > now)
+        {
+          usleep(due - now);
+        }
+      }
+
+      stats.Records++;
+      stats.Bytes += record.Length;
+
+      struct FrameParser* parser = &parsers[record.Sensor];
+      const uint8_t* bytes = record.Bytes;
+      size_t length = record.Length;
+      while(length > 0)
+      {
+        const size_t used = FrameParser_Feed(parser, bytes, length);
+        bytes += used;
+        length -= used;
+
+        struct Command frame;
+        if(!FrameParser_Poll(parser, &frame))
+        {
+          continue;
+        }
+
+        if(frame.Word[0] != 0xAA)
+        {
+          stats.AckFrames++;
+          continue;
+        }
+
+        const struct TrackedObjectGroup group = DecodeTrackedObjects(frame.Values);
+        stats.RadarFrames++;
+        stats.Targets += group.First.Present + group.Second.Present + group.Third.Present;
+
+        if(print)
+        {
+          printf("%d %llu %d %d %d %d %d %d %d %d %d\n", record.Sensor, (unsigned long long)(record.Timestamp_us - first_us),
+            group.First.X, group.First.Y, group.First.Speed,
+            group.Second.X, group.Second.Y, group.Second.Speed,
+            group.Third.X, group.Third.Y, group.Third.Speed);
+        }
+      }
+    }
+  }
+
+  const double elapsed = (NowMicros() - start) / 1e6;
+  fprintf(stderr, "%llu records  %llu bytes  %llu radar frames  %llu acks  %llu targets  %.3fs  %.1f MB/s  %.0f frames/s\n",
+    stats.Records, stats.Bytes, stats.RadarFrames, stats.AckFrames, stats.Targets, elapsed,
+    stats.Bytes / elapsed / 1e6, stats.RadarFrames / elapsed);
+
+  munmap((void*)data, info.st_size);
+  return 0;
+}
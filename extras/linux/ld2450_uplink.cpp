@@ -0,0 +1,251 @@
+// Reads the binary target stream of HLK_LD2450_Uplink.h, or writes one from a capture
+//
+//   ld2450_uplink [--baud N] DEVICE|FILE|-
+//     decodes frames from a tty (at --baud, 115200 by default), a file or stdin and prints
+//     "sensor sequence time_ms x y speed x y speed x y speed" for every frame
+//   ld2450_uplink --encode [--keyframes N] capture.ld2450
+//     encodes the radar frames of a capture (HLK_LD2450_Capture.h) the way the microcontroller
+//     would, checks that they decode to the same targets and compares the size with the text
+//     LogTrackedObjectGroup prints. The stream goes to stdout when it is not a terminal, so
+//     ld2450_uplink --encode capture.ld2450 | ld2450_uplink - decodes it again.
+//
+// g++ -std=gnu++11 -O2 -I ../.. ld2450_uplink.cpp -o ld2450_uplink
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "HLK_LD2450_Posix.h"
+#include "HLK_LD2450_Capture.h"
+#include "HLK_LD2450_Uplink.h"
+
+static unsigned long long NowNanos()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// What LogTrackedObjectGroup prints for the group, in bytes
+static size_t TextSize(const struct TrackedObjectGroup* group)
+{
+  if(EmptyGroup((struct TrackedObjectGroup*)group))
+  {
+    return 0;
+  }
+
+  const struct TrackedObject* objects[3] = { &group->First, &group->Second, &group->Third };
+  const char* names[3] = { "{ First: ", " Second: ", " Third: " };
+  char text[128];
+  size_t size = 1;
+  for(int i = 0; i < 3; i++)
+  {
+    size += snprintf(text, sizeof(text), "%s{ X: %dmm Y: %dmm Speed: %dcm/s Resolution: %dmm }", names[i],
+      objects[i]->X, objects[i]->Y, objects[i]->Speed, objects[i]->DistanceResolution);
+  }
+  return size;
+}
+
+static bool SameTargets(const struct TrackedObjectGroup* a, const struct TrackedObjectGroup* b)
+{
+  const struct TrackedObject* left[3] = { &a->First, &a->Second, &a->Third };
+  const struct TrackedObject* right[3] = { &b->First, &b->Second, &b->Third };
+  for(int i = 0; i < 3; i++)
+  {
+    if(left[i]->Present != right[i]->Present)
+    {
+      return false;
+    }
+    if(left[i]->Present && (left[i]->X != right[i]->X || left[i]->Y != right[i]->Y ||
+      left[i]->Speed != right[i]->Speed || left[i]->DistanceResolution != right[i]->DistanceResolution))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int Encode(const char* path, uint8_t keyframes)
+{
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if(fd < 0 || fstat(fd, &info) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+
+  const uint8_t* data = (const uint8_t*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  struct CaptureReader reader;
+  if(data == MAP_FAILED || !CaptureReader_Open(&reader, data, info.st_size))
+  {
+    fprintf(stderr, "%s is not a capture\n", path);
+    return 1;
+  }
+
+  const bool writeStream = !isatty(STDOUT_FILENO);
+  static struct FrameParser parsers[256];
+  static struct UplinkEncoder encoders[256];
+  static struct UplinkDecoder decoder;
+  for(int sensor = 0; sensor < 256; sensor++)
+  {
+    FrameParser_Init(&parsers[sensor]);
+    UplinkEncoder_Init(&encoders[sensor], sensor, keyframes);
+  }
+  UplinkDecoder_Init(&decoder);
+
+  unsigned long long frames = 0;
+  unsigned long long binary = 0;
+  unsigned long long text = 0;
+  unsigned long long nanos = 0;
+  unsigned long long mismatches = 0;
+  struct CaptureRecord record;
+  while(CaptureReader_Next(&reader, &record))
+  {
+    struct FrameParser* parser = &parsers[record.Sensor];
+    const uint8_t* bytes = record.Bytes;
+    size_t length = record.Length;
+    while(length > 0)
+    {
+      const size_t used = FrameParser_Feed(parser, bytes, length);
+      bytes += used;
+      length -= used;
+
+      struct Command command;
+      if(!FrameParser_Poll(parser, &command) || command.Word[0] != 0xAA)
+      {
+        continue;
+      }
+
+      const struct TrackedObjectGroup group = DecodeTrackedObjects(command.Values);
+      uint8_t frame[UPLINK_MAX_FRAME];
+      const unsigned long long start = NowNanos();
+      const uint8_t size = UplinkEncoder_Encode(&encoders[record.Sensor], &group, (uint32_t)(record.Timestamp_us / 1000), frame);
+      nanos += NowNanos() - start;
+
+      frames++;
+      binary += size;
+      text += TextSize(&group);
+      if(writeStream && fwrite(frame, 1, size, stdout) != size)
+      {
+        perror("stdout");
+        return 1;
+      }
+
+      struct UplinkFrame decoded;
+      UplinkDecoder_Feed(&decoder, frame, size);
+      if(!UplinkDecoder_Poll(&decoder, &decoded) || decoded.Sensor != record.Sensor || !SameTargets(&decoded.Group, &group))
+      {
+        mismatches++;
+      }
+    }
+  }
+
+  munmap((void*)data, info.st_size);
+  if(frames == 0)
+  {
+    fprintf(stderr, "%s has no radar frames\n", path);
+    return 1;
+  }
+
+  fprintf(stderr, "%llu frames  %.1f bytes per frame binary  %.1f as text  %.0f ns per encode  %llu did not decode the same\n",
+    frames, (double)binary / frames, (double)text / frames, (double)nanos / frames, mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
+
+static int Decode(const char* path, unsigned long baud)
+{
+  PosixTransport port;
+  int fd = STDIN_FILENO;
+  if(strcmp(path, "-") != 0)
+  {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+      perror(path);
+      return 1;
+    }
+
+    if(isatty(fd))
+    {
+      close(fd);
+      if(!port.Open(path, baud))
+      {
+        perror(path);
+        return 1;
+      }
+      fd = port.Fd;
+    }
+  }
+
+  static struct UplinkDecoder decoder;
+  UplinkDecoder_Init(&decoder);
+  uint8_t buffer[4096];
+  while(true)
+  {
+    const ssize_t result = read(fd, buffer, sizeof(buffer));
+    if(result < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+      struct pollfd wait = { fd, POLLIN, 0 };
+      poll(&wait, 1, -1);
+      continue;
+    }
+    if(result <= 0)
+    {
+      break;
+    }
+
+    const uint8_t* bytes = buffer;
+    size_t length = result;
+    while(length > 0)
+    {
+      const size_t used = UplinkDecoder_Feed(&decoder, bytes, length);
+      bytes += used;
+      length -= used;
+
+      struct UplinkFrame frame;
+      while(UplinkDecoder_Poll(&decoder, &frame))
+      {
+        const struct TrackedObjectGroup* group = &frame.Group;
+        printf("%u %lu %lu %d %d %d %d %d %d %d %d %d\n", frame.Sensor, (unsigned long)frame.Sequence, (unsigned long)frame.Time_ms,
+          group->First.X, group->First.Y, group->First.Speed,
+          group->Second.X, group->Second.Y, group->Second.Speed,
+          group->Third.X, group->Third.Y, group->Third.Speed);
+      }
+    }
+  }
+
+  fprintf(stderr, "%lu frames  %lu corrupt  %lu missed\n", (unsigned long)decoder.Frames, (unsigned long)decoder.Corrupt, (unsigned long)decoder.Missed);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  bool encode = false;
+  unsigned long baud = 115200;
+  int keyframes = 0;
+  const char* path = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--encode") == 0) encode = true;
+    else if(strcmp(argv[i], "--baud") == 0 && i + 1 < argc) baud = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--keyframes") == 0 && i + 1 < argc) keyframes = atoi(argv[++i]);
+    else path = argv[i];
+  }
+
+  if(path == NULL || keyframes < 0 || keyframes > 255)
+  {
+    fprintf(stderr, "usage: %s [--baud N] DEVICE|FILE|-\n       %s --encode [--keyframes N] capture\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  return encode ? Encode(path, (uint8_t)keyframes) : Decode(path, baud);
+}
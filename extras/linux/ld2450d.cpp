@@ -0,0 +1,609 @@
+// Acquisition daemon for a Linux gateway with many LD2450s on USB-UARTs
+//
+// Sensors are split across a few worker threads, each worker owns its sensors outright (port,
+// parser, stashed frames) and waits on all of them with one epoll, so the hot path never takes
+// a lock. Configuration commands read from stdin go to the worker that owns the sensor through
+// a small queue and an eventfd, and run on that worker between reads.
+//
+//   ld2450d [--workers N] [--quiet] [--publish /name] /dev/ttyUSB0 /dev/ttyUSB1 ...
+//     prints "sensor time_us x y speed x y speed x y speed" for every frame
+//     --publish also puts every frame in a HLK_LD2450_SharedRing.h ring for other processes
+//     --record writes everything the radars send to a capture (HLK_LD2450_Capture.h) per
+//       worker, path.0, path.1 .. or just path with one worker, see ld2450_replay.cpp
+//     stdin takes "<sensor> single|multi|restart|mac"
+//
+//   ld2450d --load-test N [--workers N] [--rate HZ] [--seconds S]
+//     runs 1, 2, 4 .. N emulated radars on ptys and reports frames per second and latency
+//     from the emulator writing a frame to the decoded targets being ready
+//
+// g++ -std=gnu++11 -O2 -pthread -I ../.. ld2450d.cpp -o ld2450d -lrt
+// add -DHLK_LD2450_STATS for per sensor parser and command counters when it exits
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HLK_LD2450_Posix.h"
+#include "HLK_LD2450_SharedRing.h"
+#include "HLK_LD2450_Capture.h"
+
+#define SHARED_RING_SLOTS 4096
+
+#define MAX_EVENTS 64
+
+static std::atomic<bool> Running(true);
+
+static unsigned long long NowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+typedef enum ConfigAction{
+  ConfigAction_SingleTarget,
+  ConfigAction_MultiTarget,
+  ConfigAction_Restart,
+  ConfigAction_GetMac
+} ConfigAction;
+
+typedef struct ConfigRequest{
+  int Sensor;
+  ConfigAction Action;
+} ConfigRequest;
+
+struct Sensor{
+  int Id;
+  std::string Path;
+  struct PosixTransport Port;
+  struct CaptureTap Tap;
+  unsigned long long Frames = 0;
+};
+
+struct Worker{
+  int Epoll = -1;
+  // written by whoever queues a request, wakes the worker out of epoll_wait
+  int Wake = -1;
+  std::vector<Sensor*> Sensors;
+  // only touched when a request comes in, never per frame
+  std::mutex QueueLock;
+  std::deque<ConfigRequest> Queue;
+  std::thread Thread;
+
+  // Load test: the emulator stamps each frame so latency covers the pty, epoll and decode
+  bool LoadTest = false;
+  bool Quiet = false;
+  // Shared by all workers, publishing never blocks
+  struct SharedRing* Ring = NULL;
+  // Only used by this worker's thread, so it needs no lock either
+  struct CaptureRecorder* Recorder = NULL;
+  FILE* RecordFile = NULL;
+  unsigned long long Frames = 0;
+  std::vector<uint32_t> Latencies_us;
+};
+
+// The load test emulator writes its send time into the third target
+#define LOAD_TEST_STAMP_OFFSET 16
+
+static void OutputFrame(Worker* worker, Sensor* sensor, const struct Command* frame)
+{
+  const struct TrackedObjectGroup group = DecodeTrackedObjects(frame->Values);
+  const unsigned long long decoded_us = NowMicros();
+
+  if(worker->LoadTest)
+  {
+    const uint32_t sent = (uint32_t)frame->Values[LOAD_TEST_STAMP_OFFSET] | ((uint32_t)frame->Values[LOAD_TEST_STAMP_OFFSET + 1] << 8) |
+      ((uint32_t)frame->Values[LOAD_TEST_STAMP_OFFSET + 2] << 16) | ((uint32_t)frame->Values[LOAD_TEST_STAMP_OFFSET + 3] << 24);
+    worker->Latencies_us.push_back((uint32_t)decoded_us - sent);
+  }
+
+  if(worker->Ring != NULL)
+  {
+    SharedRing_PublishGroup(worker->Ring, sensor->Id, decoded_us, &group);
+  }
+
+  if(!worker->Quiet && !worker->LoadTest)
+  {
+    printf("%d %llu %d %d %d %d %d %d %d %d %d\n", sensor->Id, decoded_us,
+      group.First.X, group.First.Y, group.First.Speed,
+      group.Second.X, group.Second.Y, group.Second.Speed,
+      group.Third.X, group.Third.Y, group.Third.Speed);
+  }
+}
+
+static void RunConfigRequest(Sensor* sensor, const ConfigRequest* request)
+{
+  struct PosixTransport& port = sensor->Port;
+  CommandResult status = Command_EnableConfigMode(port);
+  if(status == CommandResult_Ok)
+  {
+    switch(request->Action)
+    {
+    case ConfigAction_SingleTarget: status = Command_SetSingleTargetTracking(port); break;
+    case ConfigAction_MultiTarget: status = Command_SetMultiTargetTracking(port); break;
+    case ConfigAction_Restart: status = Command_RestartModule(port); break;
+    case ConfigAction_GetMac:
+      {
+        const MacAddress mac = Command_GetMacAddress(port);
+        fprintf(stderr, "sensor %d mac %02x:%02x:%02x:%02x:%02x:%02x\n", sensor->Id,
+          (uint8_t)mac.Bytes[0], (uint8_t)mac.Bytes[1], (uint8_t)mac.Bytes[2],
+          (uint8_t)mac.Bytes[3], (uint8_t)mac.Bytes[4], (uint8_t)mac.Bytes[5]);
+        break;
+      }
+    }
+  }
+  Command_DisableConfigMode(port);
+
+  fprintf(stderr, "sensor %d command %d result %d\n", sensor->Id, request->Action, status);
+}
+
+static void DrainQueue(Worker* worker)
+{
+  uint64_t count;
+  if(read(worker->Wake, &count, sizeof(count)) < 0 && errno != EAGAIN)
+  {
+    return;
+  }
+
+  for(;;)
+  {
+    ConfigRequest request;
+    {
+      std::lock_guard<std::mutex> lock(worker->QueueLock);
+      if(worker->Queue.empty())
+      {
+        return;
+      }
+      request = worker->Queue.front();
+      worker->Queue.pop_front();
+    }
+
+    for(Sensor* sensor : worker->Sensors)
+    {
+      if(sensor->Id == request.Sensor)
+      {
+        RunConfigRequest(sensor, &request);
+      }
+    }
+  }
+}
+
+static void RunWorker(Worker* worker)
+{
+  struct epoll_event events[MAX_EVENTS];
+  while(Running.load(std::memory_order_relaxed))
+  {
+    const int count = epoll_wait(worker->Epoll, events, MAX_EVENTS, 100);
+
+    for(int i = 0; i < count; i++)
+    {
+      Sensor* sensor = (Sensor*)events[i].data.ptr;
+      if(sensor == NULL)
+      {
+        DrainQueue(worker);
+        continue;
+      }
+
+      // everything the kernel has, TryReadCommand returns false once the tty is empty
+      struct Command frame;
+      while(TryReadCommand(sensor->Port, &frame))
+      {
+        if(frame.Word[0] != 0xAA)
+        {
+          continue;
+        }
+        sensor->Frames++;
+        worker->Frames++;
+        OutputFrame(worker, sensor, &frame);
+      }
+    }
+  }
+}
+
+static void WriteCapture(const uint8_t* bytes, size_t length, void* context)
+{
+  fwrite(bytes, 1, length, (FILE*)context);
+}
+
+static bool StartWorkers(std::vector<Worker*>& workers, std::vector<Sensor*>& sensors, size_t workerCount, bool loadTest, bool quiet, struct SharedRing* ring = NULL, const char* record = NULL)
+{
+  workerCount = std::max<size_t>(1, std::min(workerCount, sensors.size()));
+  for(size_t i = 0; i < workerCount; i++)
+  {
+    Worker* worker = new Worker();
+    worker->LoadTest = loadTest;
+    worker->Quiet = quiet;
+    worker->Ring = ring;
+    worker->Epoll = epoll_create1(EPOLL_CLOEXEC);
+    worker->Wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event wake = {};
+    wake.events = EPOLLIN;
+    wake.data.ptr = NULL;
+    epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, worker->Wake, &wake);
+
+    if(record != NULL)
+    {
+      const std::string path = workerCount == 1 ? std::string(record) : std::string(record) + "." + std::to_string(i);
+      worker->RecordFile = fopen(path.c_str(), "wb");
+      if(worker->RecordFile == NULL)
+      {
+        perror(path.c_str());
+        return false;
+      }
+
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      worker->Recorder = new CaptureRecorder();
+      CaptureRecorder_Begin(worker->Recorder, WriteCapture, worker->RecordFile, (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+    }
+
+    workers.push_back(worker);
+  }
+
+  // sensor i always lives on worker i % workers, requests are routed the same way
+  for(size_t i = 0; i < sensors.size(); i++)
+  {
+    Worker* worker = workers[i % workers.size()];
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = sensors[i];
+    if(epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, sensors[i]->Port.Fd, &event) != 0)
+    {
+      perror("epoll_ctl");
+      return false;
+    }
+    worker->Sensors.push_back(sensors[i]);
+
+    if(worker->Recorder != NULL)
+    {
+      CaptureTap_Attach(&sensors[i]->Tap, worker->Recorder, sensors[i]->Id, LinkOf(sensors[i]->Port));
+    }
+  }
+
+  Running = true;
+  for(Worker* worker : workers)
+  {
+    worker->Thread = std::thread(RunWorker, worker);
+  }
+  return true;
+}
+
+static void StopWorkers(std::vector<Worker*>& workers)
+{
+  Running = false;
+  for(Worker* worker : workers)
+  {
+    worker->Thread.join();
+    close(worker->Epoll);
+    close(worker->Wake);
+
+    if(worker->Recorder != NULL)
+    {
+      CaptureRecorder_End(worker->Recorder);
+      fclose(worker->RecordFile);
+      delete worker->Recorder;
+      worker->Recorder = NULL;
+    }
+  }
+}
+
+static void RouteRequest(std::vector<Worker*>& workers, const ConfigRequest& request)
+{
+  Worker* worker = workers[request.Sensor % workers.size()];
+  {
+    std::lock_guard<std::mutex> lock(worker->QueueLock);
+    worker->Queue.push_back(request);
+  }
+  const uint64_t one = 1;
+  if(write(worker->Wake, &one, sizeof(one)) < 0)
+  {
+    perror("eventfd");
+  }
+}
+
+static uint32_t Percentile(std::vector<uint32_t>& values, double percentile)
+{
+  if(values.empty())
+  {
+    return 0;
+  }
+  const size_t index = std::min(values.size() - 1, (size_t)(percentile * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+#if defined(HLK_LD2450_STATS)
+static void PrintStats(Sensor* sensor)
+{
+  const struct RadarLink* link = LinkOf(sensor->Port);
+  const struct ParserStats* parser = &link->Parser.Stats;
+  fprintf(stderr, "sensor %d radar %u acks %u discarded %u header mismatches %u/%u end mismatches %u/%u too large %u overruns %u\n",
+    sensor->Id, parser->Frames[STATS_FRAME_RADAR], parser->Frames[STATS_FRAME_ACK], parser->Discarded,
+    parser->HeaderMismatches[STATS_FRAME_RADAR], parser->HeaderMismatches[STATS_FRAME_ACK],
+    parser->EndMismatches[STATS_FRAME_RADAR], parser->EndMismatches[STATS_FRAME_ACK], parser->TooLarge, link->Stats.RadarOverruns);
+  fprintf(stderr, "sensor %d decode p50 <%luus p99 <%luus  round trip p50 <%luus p99 <%luus\n", sensor->Id,
+    LatencyHistogram_Percentile(&link->Stats.DecodeTime, 50), LatencyHistogram_Percentile(&link->Stats.DecodeTime, 99),
+    LatencyHistogram_Percentile(&link->Stats.RoundTrip, 50), LatencyHistogram_Percentile(&link->Stats.RoundTrip, 99));
+
+  for(uint8_t slot = 0; slot < STATS_COMMAND_SLOTS; slot++)
+  {
+    if(link->Stats.Sent[slot] == 0)
+    {
+      continue;
+    }
+    fprintf(stderr, "sensor %d command %02x sent %u retries %u timeouts %u nacks %u\n", sensor->Id,
+      slot < sizeof(StatsCommandWords) ? StatsCommandWords[slot] : 0, link->Stats.Sent[slot], link->Stats.Retries[slot],
+      link->Stats.Timeouts[slot], link->Stats.Nacks[slot]);
+  }
+}
+#endif
+
+static void HandleSignal(int)
+{
+  Running = false;
+}
+
+// Reads "<sensor> <action>" lines until stdin closes or a signal arrives
+static void RunDaemon(std::vector<Sensor*>& sensors, std::vector<Worker*>& workers)
+{
+  char line[128];
+  while(Running && fgets(line, sizeof(line), stdin) != NULL)
+  {
+    int sensor;
+    char action[32];
+    if(sscanf(line, "%d %31s", &sensor, action) != 2 || sensor < 0 || sensor >= (int)sensors.size())
+    {
+      fprintf(stderr, "expected \"<sensor> single|multi|restart|mac\"\n");
+      continue;
+    }
+
+    ConfigRequest request = { sensor, ConfigAction_SingleTarget };
+    if(strcmp(action, "single") == 0) request.Action = ConfigAction_SingleTarget;
+    else if(strcmp(action, "multi") == 0) request.Action = ConfigAction_MultiTarget;
+    else if(strcmp(action, "restart") == 0) request.Action = ConfigAction_Restart;
+    else if(strcmp(action, "mac") == 0) request.Action = ConfigAction_GetMac;
+    else
+    {
+      fprintf(stderr, "unknown action %s\n", action);
+      continue;
+    }
+
+    RouteRequest(workers, request);
+  }
+
+  // stdin closed, keep acquiring till a signal
+  while(Running)
+  {
+    pause();
+  }
+}
+
+// Load test radar on a pty master
+struct EmulatedRadar{
+  int Master = -1;
+  std::string SlavePath;
+  unsigned long long Dropped = 0;
+};
+
+static bool OpenPty(EmulatedRadar* radar)
+{
+  radar->Master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(radar->Master < 0 || grantpt(radar->Master) != 0 || unlockpt(radar->Master) != 0)
+  {
+    return false;
+  }
+  radar->SlavePath = ptsname(radar->Master);
+  return true;
+}
+
+static void EmulateRadars(std::vector<EmulatedRadar>* radars, unsigned rate_hz, std::atomic<bool>* stop)
+{
+  // target 1 walks back and forth in front of the module, target 3 carries the send time
+  uint8_t frame[30] = { 0xAA, 0xFF, 0x03, 0x00, 0x0E, 0x03, 0xB1, 0x86, 0x10, 0x00, 0x40, 0x01 };
+  frame[28] = 0x55;
+  frame[29] = 0xCC;
+
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  const long period_ns = 1000000000L / rate_hz;
+
+  while(!stop->load())
+  {
+    for(EmulatedRadar& radar : *radars)
+    {
+      const uint32_t stamp = (uint32_t)NowMicros();
+      // 1mm per ms between X -2000 and 2000 and back, X and Speed are sign-magnitude
+      const int phase = (int)(stamp / 1000 % 8000);
+      const int x = phase < 4000 ? -2000 + phase : 6000 - phase;
+      _EncodeInt16(frame + RADAR_FRAME_HEADER_SIZE, x >= 0 ? 0x8000 | x : -x);
+      _EncodeInt16(frame + RADAR_FRAME_HEADER_SIZE + 4, phase < 4000 ? 0x8000 | 100 : 100);
+      memcpy(frame + RADAR_FRAME_HEADER_SIZE + LOAD_TEST_STAMP_OFFSET, &stamp, sizeof(stamp));
+      if(write(radar.Master, frame, sizeof(frame)) != (ssize_t)sizeof(frame))
+      {
+        radar.Dropped++;
+      }
+    }
+
+    next.tv_nsec += period_ns;
+    while(next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+}
+
+static int RunLoadTest(int maxSensors, size_t workerCount, unsigned rate_hz, unsigned seconds)
+{
+  printf("sensors  workers  frames/s  p50_us  p99_us  max_us  dropped\n");
+
+  for(int count = 1; count <= maxSensors; count = count * 2 > maxSensors && count != maxSensors ? maxSensors : count * 2)
+  {
+    std::vector<EmulatedRadar> radars(count);
+    std::vector<Sensor*> sensors;
+    for(int i = 0; i < count; i++)
+    {
+      Sensor* sensor = new Sensor();
+      sensor->Id = i;
+      if(!OpenPty(&radars[i]) || !sensor->Port.Open(radars[i].SlavePath.c_str(), 256000))
+      {
+        perror("pty");
+        return 1;
+      }
+      sensors.push_back(sensor);
+    }
+
+    std::vector<Worker*> workers;
+    if(!StartWorkers(workers, sensors, workerCount, true, true))
+    {
+      return 1;
+    }
+
+    std::atomic<bool> stop(false);
+    const unsigned long long start = NowMicros();
+    std::thread emulator(EmulateRadars, &radars, rate_hz, &stop);
+    sleep(seconds);
+    stop = true;
+    emulator.join();
+    // let the last frames through
+    usleep(20000);
+    StopWorkers(workers);
+    const double elapsed = (NowMicros() - start) / 1e6;
+
+    unsigned long long frames = 0;
+    unsigned long long dropped = 0;
+    std::vector<uint32_t> latencies;
+    for(Worker* worker : workers)
+    {
+      frames += worker->Frames;
+      latencies.insert(latencies.end(), worker->Latencies_us.begin(), worker->Latencies_us.end());
+      delete worker;
+    }
+    for(EmulatedRadar& radar : radars)
+    {
+      dropped += radar.Dropped;
+      close(radar.Master);
+    }
+    for(Sensor* sensor : sensors)
+    {
+      sensor->Port.Close();
+      delete sensor;
+    }
+
+    const uint32_t worst = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+    printf("%7d  %7zu  %8.0f  %6u  %6u  %6u  %7llu\n", count, std::min<size_t>(workerCount, count), frames / elapsed,
+      Percentile(latencies, 0.50), Percentile(latencies, 0.99), worst, dropped);
+    fflush(stdout);
+
+    if(count == maxSensors)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  size_t workerCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+  int loadTest = 0;
+  unsigned rate_hz = 10;
+  unsigned seconds = 5;
+  bool quiet = false;
+  const char* publish = NULL;
+  const char* record = NULL;
+  std::vector<Sensor*> sensors;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc) workerCount = std::max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--load-test") == 0 && i + 1 < argc) loadTest = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rate_hz = std::max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = std::max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--quiet") == 0) quiet = true;
+    else if(strcmp(argv[i], "--publish") == 0 && i + 1 < argc) publish = argv[++i];
+    else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) record = argv[++i];
+    else
+    {
+      Sensor* sensor = new Sensor();
+      sensor->Id = sensors.size();
+      sensor->Path = argv[i];
+      sensors.push_back(sensor);
+    }
+  }
+
+  if(loadTest > 0)
+  {
+    return RunLoadTest(loadTest, workerCount, rate_hz, seconds);
+  }
+
+  if(sensors.empty())
+  {
+    fprintf(stderr, "usage: %s [--workers N] [--quiet] [--publish /name] [--record path] tty...\n       %s --load-test N [--workers N] [--rate HZ] [--seconds S]\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  for(Sensor* sensor : sensors)
+  {
+    if(!sensor->Port.Open(sensor->Path.c_str(), 256000))
+    {
+      perror(sensor->Path.c_str());
+      return 1;
+    }
+
+    struct InitReport report;
+    InitRadar(sensor->Port, &report);
+    fprintf(stderr, "sensor %d %s ready %d after %lums at %lu baud\n", sensor->Id, sensor->Path.c_str(),
+      report.Ready, report.TimeToReady_ms, BaudRateValue(report.BaudRate));
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = HandleSignal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  struct SharedRing ring;
+  if(publish != NULL && !SharedRing_Create(&ring, publish, SHARED_RING_SLOTS))
+  {
+    perror(publish);
+    return 1;
+  }
+
+  std::vector<Worker*> workers;
+  if(!StartWorkers(workers, sensors, workerCount, false, quiet, publish != NULL ? &ring : NULL, record))
+  {
+    return 1;
+  }
+
+  RunDaemon(sensors, workers);
+  StopWorkers(workers);
+
+  for(Sensor* sensor : sensors)
+  {
+    fprintf(stderr, "sensor %d frames %llu\n", sensor->Id, sensor->Frames);
+#if defined(HLK_LD2450_STATS)
+    PrintStats(sensor);
+#endif
+  }
+
+  if(publish != NULL)
+  {
+    SharedRing_Close(&ring);
+    shm_unlink(publish);
+  }
+  return 0;
+}